@@ -0,0 +1,409 @@
+#include <spdlog/spdlog.h>
+
+#include "block_fetcher.h"
+#include "util/buffer_archive.h"
+
+namespace HotStuff
+{
+
+// Checks that the blocks of a response lie within the range, and that each is the parent of the one before it.
+static bool is_chain(const BlockResponse &response, Round min_round, Round max_round)
+{
+	if (response.min_round < min_round || response.min_round > max_round)
+	{
+		return false;
+	}
+
+	for (size_t i = 0; i < response.blocks.size(); i++)
+	{
+		auto &block = response.blocks[i];
+		if (block->round() < response.min_round || block->round() > max_round)
+		{
+			return false;
+		}
+		if (i > 0 && response.blocks[i - 1]->parent_hash() != block->hash())
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+BlockFetcher::BlockFetcher(asio::io_context &io_context, ID id, std::shared_ptr<BlockChain> chain,
+                           std::shared_ptr<Network> network, std::vector<ID> peers,
+                           std::shared_ptr<const BlockLog> log, BlockFetcherOptions options)
+    : m_io_context(io_context), m_id(id), m_chain(std::move(chain)), m_network(std::move(network)),
+      m_peers(std::move(peers)), m_log(std::move(log)), m_options(options)
+{
+}
+
+void BlockFetcher::start()
+{
+	// The network outlives the fetcher's callbacks, so they must not keep the fetcher alive.
+	m_network->on_block_request([weak = weak_from_this()](BlockRequest request) {
+		if (auto self = weak.lock())
+		{
+			self->m_network->send_block_response(request.requester, self->serve(request));
+		}
+	});
+
+	m_network->on_block_response([weak = weak_from_this()](BlockResponse response) {
+		if (auto self = weak.lock())
+		{
+			self->handle_response(std::move(response));
+		}
+	});
+}
+
+void BlockFetcher::fetch(const QuorumCert &cert, Round min_round, std::function<void(bool)> on_done)
+{
+	if (m_chain->get(cert.block_hash()))
+	{
+		on_done(true);
+		return;
+	}
+
+	for (auto &fetch : m_fetches)
+	{
+		if (fetch.target == cert.block_hash())
+		{
+			fetch.callbacks.push_back(std::move(on_done));
+			return;
+		}
+	}
+
+	m_fetches.push_back(Fetch{cert.block_hash(), cert.round(), min_round, {std::move(on_done)}});
+	if (m_fetches.size() == 1)
+	{
+		start_fetch();
+	}
+}
+
+BlockResponse BlockFetcher::serve(const BlockRequest &request) const
+{
+	BlockResponse response;
+	response.id = request.id;
+	response.found = get(request.head) != nullptr;
+	response.min_round = request.min_round;
+
+	auto block = m_chain->ancestor_at_round(request.head, request.max_round);
+	if (!block && m_log)
+	{
+		block = log_ancestor_at_round(request.head, request.max_round);
+	}
+
+	size_t num_bytes = 0;
+	for (; block && block->round() >= request.min_round; block = get(block->parent_hash()))
+	{
+		SizeArchive size_archive;
+		size_archive(*block);
+
+		if (!response.blocks.empty() && num_bytes + size_archive.size() > m_options.max_response_bytes)
+		{
+			response.min_round = response.blocks.back()->round();
+			break;
+		}
+
+		num_bytes += size_archive.size();
+		response.blocks.push_back(block);
+	}
+
+	return response;
+}
+
+void BlockFetcher::start_fetch()
+{
+	auto &fetch = m_fetches.front();
+	m_next = fetch.target;
+	m_num_reanchors = 0;
+
+	if (fetch.target_round > fetch.min_round && fetch.target_round - fetch.min_round > m_options.max_fetch_rounds)
+	{
+		spdlog::warn("not fetching blocks in rounds {}-{}, which are too many", fetch.min_round + 1,
+		             fetch.target_round);
+		finish_fetch(false);
+		return;
+	}
+
+	for (Round max_round = fetch.target_round; max_round > fetch.min_round;)
+	{
+		Round min_round = std::max(fetch.min_round + 1, max_round - std::min(max_round, m_options.batch_rounds - 1));
+		m_ranges.emplace(max_round, Range{min_round, max_round, fetch.target, false, false, 0, {}});
+		max_round = min_round - 1;
+	}
+
+	if (m_chain->get(fetch.target) || m_ranges.empty())
+	{
+		finish_fetch(m_chain->get(fetch.target) != nullptr);
+		return;
+	}
+
+	spdlog::info("fetching blocks in rounds {}-{}", fetch.min_round + 1, fetch.target_round);
+	send_requests();
+}
+
+void BlockFetcher::finish_fetch(bool success)
+{
+	for (auto &[_, request] : m_requests)
+	{
+		request.timer->cancel();
+	}
+	m_requests.clear();
+	m_in_flight.clear();
+	m_ranges.clear();
+	m_fetched.clear();
+
+	auto callbacks = std::move(m_fetches.front().callbacks);
+	m_fetches.pop_front();
+
+	// The next fetch is started before the callbacks run, in case they start another one.
+	if (!m_fetches.empty())
+	{
+		start_fetch();
+	}
+
+	for (auto &callback : callbacks)
+	{
+		callback(success);
+	}
+}
+
+void BlockFetcher::send_requests()
+{
+	for (auto &[max_round, range] : m_ranges)
+	{
+		if (range.requested)
+		{
+			continue;
+		}
+
+		// take turns between the peers that have room for another request
+		std::optional<ID> peer;
+		for (size_t i = 0; i < m_peers.size() && !peer; i++)
+		{
+			ID candidate = m_peers[m_next_peer++ % m_peers.size()];
+			if (m_in_flight[candidate] < m_options.max_in_flight)
+			{
+				peer = candidate;
+			}
+		}
+		if (!peer)
+		{
+			return;
+		}
+
+		uint64_t id = m_next_request++;
+		// If the request cannot be sent, it times out and is sent to another peer.
+		m_network->send_block_request(*peer, BlockRequest{m_id, id, range.head, range.min_round, range.max_round});
+
+		auto timer = std::make_unique<asio::steady_timer>(m_io_context, m_options.request_timeout);
+		timer->async_wait([weak = weak_from_this(), id](std::error_code error) {
+			auto self = weak.lock();
+			if (self && !error)
+			{
+				self->handle_failure(id);
+			}
+		});
+
+		range.requested = true;
+		m_in_flight[*peer]++;
+		m_requests.emplace(id, Request{max_round, *peer, std::move(timer)});
+	}
+}
+
+std::optional<BlockFetcher::Request> BlockFetcher::take_request(uint64_t id)
+{
+	auto iter = m_requests.find(id);
+	if (iter == m_requests.end())
+	{
+		return std::nullopt;
+	}
+
+	auto request = std::move(iter->second);
+	m_requests.erase(iter);
+	request.timer->cancel();
+	m_in_flight[request.peer]--;
+	return request;
+}
+
+void BlockFetcher::handle_response(BlockResponse response)
+{
+	// responses to requests that timed out, or that belong to a finished fetch, are ignored
+	auto request = take_request(response.id);
+	if (!request)
+	{
+		return;
+	}
+
+	auto iter = m_ranges.find(request->range);
+	if (iter == m_ranges.end())
+	{
+		send_requests();
+		return;
+	}
+	auto &range = iter->second;
+
+	if (!response.found || !is_chain(response, range.min_round, range.max_round))
+	{
+		spdlog::warn("peer {} sent an unusable response for rounds {}-{}", request->peer, range.min_round,
+		             range.max_round);
+		if (retry(range))
+		{
+			send_requests();
+		}
+		return;
+	}
+
+	if (response.min_round > range.min_round)
+	{
+		// the response was cut short, so the rest of the range is requested separately
+		m_ranges.emplace(response.min_round - 1,
+		                 Range{range.min_round, response.min_round - 1, range.head, false, false, 0, {}});
+		range.min_round = response.min_round;
+	}
+
+	range.received = true;
+	range.blocks = std::move(response.blocks);
+	verify();
+}
+
+void BlockFetcher::handle_failure(uint64_t id)
+{
+	auto request = take_request(id);
+	if (!request)
+	{
+		return;
+	}
+
+	auto range = m_ranges.find(request->range);
+	if (range == m_ranges.end())
+	{
+		send_requests();
+		return;
+	}
+
+	spdlog::warn("request to peer {} for rounds {}-{} timed out", request->peer, range->second.min_round,
+	             range->second.max_round);
+	if (retry(range->second))
+	{
+		send_requests();
+	}
+}
+
+bool BlockFetcher::retry(Range &range)
+{
+	range.requested = false;
+	range.received = false;
+	range.blocks.clear();
+
+	if (++range.num_attempts >= m_options.max_attempts)
+	{
+		spdlog::error("giving up fetching rounds {}-{}", range.min_round, range.max_round);
+		finish_fetch(false);
+		return false;
+	}
+	return true;
+}
+
+bool BlockFetcher::reanchor(Round min_round)
+{
+	Round max_round = m_fetched.empty() ? m_fetches.front().target_round : m_fetched.back()->round() - 1;
+
+	if (max_round < min_round || ++m_num_reanchors > m_options.max_attempts)
+	{
+		spdlog::error("cannot link fetched blocks up with the chain");
+		finish_fetch(false);
+		return false;
+	}
+
+	m_ranges.emplace(max_round, Range{min_round, max_round, m_next, false, false, 0, {}});
+	return true;
+}
+
+void BlockFetcher::verify()
+{
+	bool linked = m_chain->get(m_next) != nullptr;
+
+	while (!linked && !m_ranges.empty() && m_ranges.begin()->second.received)
+	{
+		auto &range = m_ranges.begin()->second;
+
+		for (auto &block : range.blocks)
+		{
+			if (block->hash() != m_next)
+			{
+				// Either this range, or a range above it that left out blocks, was wrong.
+				Round min_round = range.min_round;
+				m_ranges.erase(m_ranges.begin());
+				if (reanchor(min_round))
+				{
+					send_requests();
+				}
+				return;
+			}
+
+			m_fetched.push_back(block);
+			m_next = block->parent_hash();
+			m_num_reanchors = 0;
+			linked = m_chain->get(m_next) != nullptr;
+			if (linked)
+			{
+				break;
+			}
+		}
+
+		m_ranges.erase(m_ranges.begin());
+	}
+
+	if (linked)
+	{
+		for (auto block = m_fetched.rbegin(); block != m_fetched.rend(); block++)
+		{
+			m_chain->add(*block);
+		}
+		spdlog::info("fetched {} blocks", m_fetched.size());
+		finish_fetch(true);
+		return;
+	}
+
+	// All ranges were verified, but the blocks did not reach the chain. Some range must have left out blocks.
+	if (m_ranges.empty() && !reanchor(m_fetches.front().min_round + 1))
+	{
+		return;
+	}
+
+	send_requests();
+}
+
+BlockPtr BlockFetcher::get(const Hash &hash) const
+{
+	auto block = m_chain->get(hash);
+	if (!block && m_log)
+	{
+		block = m_log->read(hash);
+	}
+	return block;
+}
+
+BlockPtr BlockFetcher::log_ancestor_at_round(const Hash &head, Round round) const
+{
+	// The chain is pruned down to the committed block, so its blocks are few, and the log continues below them.
+	Hash hash = head;
+	for (auto block = m_chain->get(hash); block; block = m_chain->get(hash))
+	{
+		hash = block->parent_hash();
+	}
+
+	for (auto view = m_log->view(hash); view; view = m_log->view(hash))
+	{
+		if (view->round() <= round)
+		{
+			return view->decode();
+		}
+		hash = view->parent_hash();
+	}
+	return nullptr;
+}
+
+} // namespace HotStuff
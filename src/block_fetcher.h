@@ -0,0 +1,153 @@
+#pragma once
+
+#include <asio/io_context.hpp>
+#include <asio/steady_timer.hpp>
+#include <chrono>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <optional>
+#include <unordered_map>
+#include <vector>
+
+#include "block_log.h"
+#include "blockchain.h"
+#include "crypto.h"
+#include "network.h"
+#include "types.h"
+
+namespace HotStuff
+{
+
+class BlockFetcherOptions
+{
+  public:
+	// Number of rounds asked for by a single request.
+	Round batch_rounds = 256;
+	// A fetch that spans more rounds than this fails right away, rather than setting up ranges up to any round that a
+	// QC claims. A replica that is further behind has to catch up from a checkpoint instead.
+	Round max_fetch_rounds = 1024 * 1024;
+	// Responses are cut short after this many bytes of blocks. This must stay below the network's message size limit.
+	size_t max_response_bytes = 512 * 1024;
+	// Number of requests that may be outstanding at a single peer.
+	size_t max_in_flight = 4;
+	// A request that is not answered in time is sent to another peer.
+	std::chrono::milliseconds request_timeout{1000};
+	// The fetch fails once the requests for a single range have failed this many times,
+	// or once this many ranges in a row did not link up with the verified blocks.
+	size_t max_attempts = 16;
+};
+
+// Fetches blocks that are missing from the chain from other replicas, and serves their requests for blocks.
+//
+// The missing rounds are split into ranges, which are requested from all peers in parallel, with several requests
+// outstanding per peer. Responses may arrive in any order, and are verified from the newest block down: the newest
+// block must be the one certified by the QC that the fetch started from, and every other block must be the parent of
+// the one above it. The hashes link each block to the certified one, so the QCs embedded in the fetched blocks need not
+// be verified again. A range whose blocks do not link up is requested again from another peer, anchored at the last
+// verified block.
+//
+// The fetcher is not thread safe. It must only be used from the thread that runs the network's io_context.
+class BlockFetcher : public std::enable_shared_from_this<BlockFetcher>
+{
+  public:
+	// If set, log holds the blocks that were pruned from the chain, so that peers can still fetch them.
+	BlockFetcher(asio::io_context &io_context, ID id, std::shared_ptr<BlockChain> chain,
+	             std::shared_ptr<Network> network, std::vector<ID> peers,
+	             std::shared_ptr<const BlockLog> log = nullptr, BlockFetcherOptions options = {});
+
+	// Registers with the network to serve requests from peers and to receive their responses.
+	void start();
+
+	// Fetches the block certified by cert along with its ancestors above min_round, and adds them to the chain,
+	// oldest first. The QC must already have been verified.
+	// on_done is called with true once the certified block is in the chain, or with false if it could not be fetched.
+	// Fetches run one at a time, in the order in which they were started.
+	void fetch(const QuorumCert &cert, Round min_round, std::function<void(bool)> on_done);
+
+	// Answers a request with blocks from the chain, or from the log once they have been pruned from the chain.
+	BlockResponse serve(const BlockRequest &request) const;
+
+  private:
+	// A range of rounds that is requested at once.
+	class Range
+	{
+	  public:
+		Round min_round;
+		Round max_round;
+		// The chain from which the blocks are requested.
+		Hash head;
+		bool requested = false;
+		bool received = false;
+		size_t num_attempts = 0;
+		// Newest first.
+		std::vector<BlockPtr> blocks;
+	};
+
+	class Request
+	{
+	  public:
+		// The max_round of the range, which is its key in m_ranges.
+		Round range;
+		ID peer;
+		std::unique_ptr<asio::steady_timer> timer;
+	};
+
+	class Fetch
+	{
+	  public:
+		Hash target;
+		Round target_round;
+		Round min_round;
+		std::vector<std::function<void(bool)>> callbacks;
+	};
+
+	typedef std::map<Round, Range, std::greater<Round>> Ranges;
+
+	asio::io_context &m_io_context;
+	ID m_id;
+	std::shared_ptr<BlockChain> m_chain;
+	std::shared_ptr<Network> m_network;
+	std::vector<ID> m_peers;
+	std::shared_ptr<const BlockLog> m_log;
+	BlockFetcherOptions m_options;
+
+	// The first fetch is the one in progress.
+	std::deque<Fetch> m_fetches;
+	// The ranges of the current fetch that have not been verified yet, newest first.
+	Ranges m_ranges;
+	// The hash of the next block to verify, going down from the target.
+	Hash m_next{};
+	// The blocks verified so far, newest first.
+	std::vector<BlockPtr> m_fetched;
+	// Number of times reanchor() was called since the last block was verified.
+	size_t m_num_reanchors = 0;
+
+	std::unordered_map<uint64_t, Request> m_requests;
+	std::unordered_map<ID, size_t> m_in_flight;
+	uint64_t m_next_request = 0;
+	size_t m_next_peer = 0;
+
+	void start_fetch();
+	void finish_fetch(bool success);
+	void send_requests();
+	void handle_response(BlockResponse response);
+	void handle_failure(uint64_t request);
+	// Marks a range as not requested, so that it is requested again.
+	// Returns false, after failing the fetch, if the range has failed too often.
+	bool retry(Range &range);
+	// Adds a range that reaches up to the last verified block and is requested from its parent, so that only blocks
+	// that link up with it are returned. Returns false, after failing the fetch, if this has happened too often.
+	bool reanchor(Round min_round);
+	// Verifies the blocks of the newest ranges, as far as they have been received.
+	void verify();
+	std::optional<Request> take_request(uint64_t id);
+	// Returns the block from the chain, or from the log if it is not in the chain.
+	BlockPtr get(const Hash &hash) const;
+	// Returns the ancestor of head (or head itself) with the highest round that is at most round, among the blocks
+	// that are only in the log.
+	BlockPtr log_ancestor_at_round(const Hash &head, Round round) const;
+};
+
+} // namespace HotStuff
@@ -0,0 +1,204 @@
+#include <asio/io_context.hpp>
+#include <catch2/catch_test_macros.hpp>
+#include <chrono>
+#include <thread>
+
+#include "block_fetcher.h"
+#include "tests/util.h"
+
+using namespace HotStuff;
+using namespace std::chrono_literals;
+
+static std::shared_ptr<BlockChain> make_blockchain(const std::vector<BlockPtr> &blocks)
+{
+	auto chain = std::make_shared<BlockChain>();
+	for (auto &block : blocks)
+	{
+		chain->add(block);
+	}
+	return chain;
+}
+
+TEST_CASE("Serve ranges of blocks from the chain", "[block_fetcher]")
+{
+	asio::io_context io_context;
+	auto blocks = make_chain(100, 100);
+	auto chain = make_blockchain(blocks);
+
+	BlockFetcherOptions options;
+	options.max_response_bytes = 1000;
+	auto network = std::make_shared<Network>(io_context);
+	BlockFetcher fetcher(io_context, 1, chain, network, {}, nullptr, options);
+
+	auto response = fetcher.serve(BlockRequest{2, 7, blocks[99]->hash(), 91, 93});
+	REQUIRE(response.id == 7);
+	REQUIRE(response.found);
+	REQUIRE(response.min_round == 91);
+	REQUIRE(response.blocks.size() == 3);
+	for (size_t i = 0; i < response.blocks.size(); i++)
+	{
+		REQUIRE(response.blocks[i]->hash() == blocks[92 - i]->hash());
+	}
+
+	// cut short after a few blocks
+	response = fetcher.serve(BlockRequest{2, 8, blocks[99]->hash(), 1, 100});
+	REQUIRE(response.found);
+	REQUIRE(!response.blocks.empty());
+	REQUIRE(response.blocks.size() < 100);
+	REQUIRE(response.min_round == response.blocks.back()->round());
+	REQUIRE(response.blocks.front()->round() == 100);
+
+	// the blocks come from the chain that ends at the head, not from later blocks
+	response = fetcher.serve(BlockRequest{2, 9, blocks[49]->hash(), 51, 100});
+	REQUIRE(response.found);
+	REQUIRE(response.blocks.empty());
+
+	response = fetcher.serve(BlockRequest{2, 10, make_chain(1, 100, 1)[0]->hash(), 1, 100});
+	REQUIRE(!response.found);
+	REQUIRE(response.blocks.empty());
+}
+
+TEST_CASE("Serve blocks that were pruned from the chain from the log", "[block_fetcher]")
+{
+	asio::io_context io_context;
+	auto blocks = make_chain(100, 100);
+	auto chain = make_blockchain(blocks);
+	TempDirectory dir;
+	auto log = std::make_shared<BlockLog>(dir.path);
+	chain->prune(blocks[79]->hash(), [&](const BlockPtr &block) { log->append(*block); });
+
+	auto network = std::make_shared<Network>(io_context);
+	BlockFetcher fetcher(io_context, 1, chain, network, {}, log);
+	auto require_rounds = [&](const BlockResponse &response, Round max_round, Round min_round) {
+		REQUIRE(response.found);
+		REQUIRE(response.blocks.size() == max_round - min_round + 1);
+		for (size_t i = 0; i < response.blocks.size(); i++)
+		{
+			REQUIRE(response.blocks[i]->hash() == blocks[max_round - 1 - i]->hash());
+		}
+	};
+
+	// below the root of the chain, from the head of the chain or from a block in the log
+	require_rounds(fetcher.serve(BlockRequest{2, 1, blocks[99]->hash(), 10, 20}), 20, 10);
+	require_rounds(fetcher.serve(BlockRequest{2, 2, blocks[49]->hash(), 40, 45}), 45, 40);
+	// across the root of the chain
+	require_rounds(fetcher.serve(BlockRequest{2, 3, blocks[99]->hash(), 75, 85}), 85, 75);
+
+	BlockFetcher without_log(io_context, 1, chain, network, {});
+	REQUIRE(without_log.serve(BlockRequest{2, 4, blocks[99]->hash(), 10, 20}).blocks.empty());
+	REQUIRE(!without_log.serve(BlockRequest{2, 5, blocks[49]->hash(), 40, 45}).found);
+}
+
+TEST_CASE("Catch up with missing blocks from several peers", "[block_fetcher]")
+{
+	asio::io_context io_context;
+	auto blocks = make_chain(1000, 100);
+	auto server_chain = make_blockchain(blocks);
+	auto client_chain = make_blockchain({blocks.begin(), blocks.begin() + 100});
+
+	TempDirectory dir;
+	std::shared_ptr<BlockLog> server_log;
+	SECTION("The peers have all blocks in their chain")
+	{
+	}
+	SECTION("The peers have pruned the committed blocks from their chain")
+	{
+		server_log = std::make_shared<BlockLog>(dir.path);
+		server_chain->prune(blocks[899]->hash(), [&](const BlockPtr &block) { server_log->append(*block); });
+	}
+
+	BlockFetcherOptions options;
+	options.batch_rounds = 50;
+	options.max_response_bytes = 2000;
+
+	std::optional<bool> result;
+	std::shared_ptr<BlockFetcher> client;
+	auto networks = make_networks(io_context, {1, 2, 3, 4}, [&]() {
+		client->fetch(QuorumCert(blocks.back()->hash(), blocks.back()->round(), {}), 0, [&](bool success) {
+			result = success;
+			io_context.stop();
+		});
+	});
+
+	client = std::make_shared<BlockFetcher>(io_context, 1, client_chain, networks[0], std::vector<ID>{2, 3, 4},
+	                                        nullptr, options);
+	client->start();
+	std::vector<std::shared_ptr<BlockFetcher>> servers;
+	for (ID id = 2; id <= 4; id++)
+	{
+		servers.push_back(std::make_shared<BlockFetcher>(io_context, id, server_chain, networks[id - 1],
+		                                                 std::vector<ID>{}, server_log, options));
+		servers.back()->start();
+	}
+
+	auto thread = std::thread([&]() { REQUIRE_NOTHROW(io_context.run_for(10s)); });
+	thread.join();
+
+	REQUIRE(result == true);
+	REQUIRE(client_chain->size() == blocks.size() + 1);
+	REQUIRE(client_chain->extends(blocks.back()->hash(), GENESIS.hash()));
+}
+
+TEST_CASE("Discard blocks that do not link up with the certified block", "[block_fetcher]")
+{
+	asio::io_context io_context;
+	auto blocks = make_chain(300, 100);
+	auto forged = make_chain(300, 100, 1);
+	auto server_chain = make_blockchain(blocks);
+	auto client_chain = make_blockchain({});
+
+	BlockFetcherOptions options;
+	options.batch_rounds = 20;
+	options.request_timeout = 100ms;
+
+	std::optional<bool> result;
+	std::shared_ptr<BlockFetcher> client;
+	auto networks = make_networks(io_context, {1, 2, 3, 4}, [&]() {
+		client->fetch(QuorumCert(blocks.back()->hash(), blocks.back()->round(), {}), 0, [&](bool success) {
+			result = success;
+			io_context.stop();
+		});
+	});
+
+	client = std::make_shared<BlockFetcher>(io_context, 1, client_chain, networks[0], std::vector<ID>{2, 3, 4},
+	                                        nullptr, options);
+	client->start();
+	auto server =
+	    std::make_shared<BlockFetcher>(io_context, 2, server_chain, networks[1], std::vector<ID>{}, nullptr, options);
+	server->start();
+
+	// peer 3 answers with blocks from another chain, and peer 4 does not answer at all
+	auto forger = std::make_shared<BlockFetcher>(io_context, 3, make_blockchain(forged), networks[2], std::vector<ID>{},
+	                                             nullptr, options);
+	networks[2]->on_block_request([&](BlockRequest request) {
+		request.head = forged.back()->hash();
+		networks[2]->send_block_response(request.requester, forger->serve(request));
+	});
+	networks[3]->on_block_request([](BlockRequest) {});
+
+	auto thread = std::thread([&]() { REQUIRE_NOTHROW(io_context.run_for(10s)); });
+	thread.join();
+
+	REQUIRE(result == true);
+	REQUIRE(client_chain->size() == blocks.size() + 1);
+	REQUIRE(client_chain->extends(blocks.back()->hash(), GENESIS.hash()));
+	REQUIRE(!client_chain->get(forged[150]->hash()));
+}
+
+TEST_CASE("Refuse to fetch more rounds than the window", "[block_fetcher]")
+{
+	asio::io_context io_context;
+	auto blocks = make_chain(10, 100);
+	auto chain = make_blockchain(blocks);
+
+	BlockFetcherOptions options;
+	options.max_fetch_rounds = 1000;
+	auto network = std::make_shared<Network>(io_context);
+	auto fetcher = std::make_shared<BlockFetcher>(io_context, 1, chain, network, std::vector<ID>{2}, nullptr, options);
+
+	// a QC that claims a round far beyond the chain
+	std::optional<bool> result;
+	fetcher->fetch(QuorumCert(make_chain(1, 100, 1)[0]->hash(), Round(1) << 62, {}), 10,
+	               [&](bool success) { result = success; });
+	REQUIRE(result == false);
+}
@@ -0,0 +1,432 @@
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <filesystem>
+#include <fmt/core.h>
+#include <spdlog/spdlog.h>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <system_error>
+#include <unistd.h>
+
+#include "block_log.h"
+#include "util/buffer_archive.h"
+#include "util/crc32.h"
+
+const uint64_t INDEX_MAGIC = 0x676f6c6b636f6c62; // "blocklog"
+const size_t INITIAL_INDEX_CAPACITY = 1024;      // in entries
+// Each record starts with the size of the encoded block and its checksum.
+const size_t RECORD_HEADER_SIZE = 2 * sizeof(uint32_t);
+
+namespace HotStuff
+{
+
+static std::system_error system_error(const std::string &what)
+{
+	return std::system_error(errno, std::generic_category(), what);
+}
+
+BlockPtr BlockView::decode() const
+{
+	auto block = std::make_shared<Block>();
+	BufferInputArchive iarchive(data, size);
+	iarchive(*block);
+	return block;
+}
+
+Hash BlockView::parent_hash() const
+{
+	Hash parent;
+	BufferInputArchive iarchive(data, size);
+	iarchive(parent);
+	return parent;
+}
+
+Round BlockView::round() const
+{
+	Hash parent;
+	Round round;
+	BufferInputArchive iarchive(data, size);
+	iarchive(parent, round);
+	return round;
+}
+
+BlockLog::BlockLog(std::string directory, BlockLogOptions options)
+    : m_directory(std::move(directory)), m_options(options), m_crc(Botan::HashFunction::create_or_throw("CRC32"))
+{
+	std::filesystem::create_directories(m_directory);
+
+	open_index();
+
+	size_t num_segments = 0;
+	while (std::filesystem::exists(segment_path(num_segments)))
+	{
+		open_segment(num_segments++);
+	}
+	if (num_segments == 0)
+	{
+		open_segment(0);
+	}
+
+	// The entries are in log order, so those of the last segment are at the end.
+	// They are dropped here, and added back while the segment is scanned.
+	auto &header = index_header();
+	header.num_entries = std::min<uint64_t>(header.num_entries, m_index_capacity);
+	while (header.num_entries > 0 && index_entries()[header.num_entries - 1].segment >= m_segments.size() - 1)
+	{
+		header.num_entries--;
+	}
+
+	for (uint64_t i = 0; i < header.num_entries; i++)
+	{
+		const auto &entry = index_entries()[i];
+		if (entry.segment >= m_segments.size() ||
+		    entry.offset + RECORD_HEADER_SIZE + entry.size > m_segments[entry.segment].size)
+		{
+			throw std::runtime_error(fmt::format("corrupted block log index in {}", m_directory));
+		}
+		m_positions.insert(entry.hash, i);
+	}
+
+	recover_last_segment();
+}
+
+BlockLog::~BlockLog()
+{
+	try
+	{
+		sync();
+	}
+	catch (const std::system_error &e)
+	{
+		spdlog::error("error syncing block log {}: {}", m_directory, e.what());
+	}
+
+	for (auto &segment : m_segments)
+	{
+		munmap(segment.data, segment.size);
+		close(segment.fd);
+	}
+
+	munmap(m_index_data, sizeof(IndexHeader) + m_index_capacity * sizeof(IndexEntry));
+	close(m_index_fd);
+}
+
+bool BlockLog::append(const Block &block)
+{
+	if (m_positions.count(block.hash()))
+	{
+		return true;
+	}
+
+	auto record = serialize_to_buffer(block, RECORD_HEADER_SIZE);
+	if (record.size() > m_options.segment_size)
+	{
+		spdlog::error("block of {} bytes does not fit in a block log segment", record.size());
+		return false;
+	}
+
+	if (m_segments.back().end + record.size() > m_segments.back().size)
+	{
+		// Only the last segment is scanned on recovery, so the full one must be on disk before moving on.
+		sync();
+		open_segment(m_segments.size());
+	}
+
+	uint32_t size = record.size() - RECORD_HEADER_SIZE;
+	uint32_t crc = checksum(record.data() + RECORD_HEADER_SIZE, size);
+	std::memcpy(record.data(), &size, sizeof(size));
+	std::memcpy(record.data() + sizeof(size), &crc, sizeof(crc));
+
+	auto &segment = m_segments.back();
+	for (size_t written = 0; written < record.size();)
+	{
+		ssize_t n = pwrite(segment.fd, record.data() + written, record.size() - written, segment.end + written);
+		if (n < 0)
+		{
+			if (errno == EINTR)
+			{
+				continue;
+			}
+			throw system_error("error writing to block log " + segment_path(m_segments.size() - 1));
+		}
+		written += n;
+	}
+
+	add_index_entry({block.hash(), static_cast<uint32_t>(m_segments.size() - 1), size, segment.end});
+	segment.end += record.size();
+
+	return true;
+}
+
+void BlockLog::sync()
+{
+	if (fdatasync(m_segments.back().fd) != 0)
+	{
+		throw system_error("error syncing block log " + segment_path(m_segments.size() - 1));
+	}
+
+	if (msync(m_index_data, sizeof(IndexHeader) + m_index_capacity * sizeof(IndexEntry), MS_SYNC) != 0 ||
+	    fdatasync(m_index_fd) != 0)
+	{
+		throw system_error("error syncing block log index in " + m_directory);
+	}
+}
+
+size_t BlockLog::size() const
+{
+	return m_positions.size();
+}
+
+bool BlockLog::contains(const Hash &hash) const
+{
+	return m_positions.count(hash);
+}
+
+std::optional<uint64_t> BlockLog::position(const Hash &hash) const
+{
+	auto position = m_positions.find(hash);
+	if (!position)
+	{
+		return std::nullopt;
+	}
+	return *position;
+}
+
+std::optional<BlockView> BlockLog::view(const Hash &hash) const
+{
+	auto position = m_positions.find(hash);
+	if (!position)
+	{
+		return std::nullopt;
+	}
+	return view(index_entries()[*position]);
+}
+
+BlockPtr BlockLog::read(const Hash &hash) const
+{
+	auto block_view = view(hash);
+	return block_view ? block_view->decode() : nullptr;
+}
+
+void BlockLog::for_each(const std::function<void(BlockPtr)> &f, size_t first) const
+{
+	for (uint64_t i = first; i < index_header().num_entries; i++)
+	{
+		f(view(index_entries()[i]).decode());
+	}
+}
+
+BlockLog::IndexHeader &BlockLog::index_header() const
+{
+	return *reinterpret_cast<IndexHeader *>(m_index_data);
+}
+
+BlockLog::IndexEntry *BlockLog::index_entries() const
+{
+	return reinterpret_cast<IndexEntry *>(m_index_data + sizeof(IndexHeader));
+}
+
+std::string BlockLog::segment_path(size_t segment) const
+{
+	return fmt::format("{}/{:08}.log", m_directory, segment);
+}
+
+void BlockLog::open_segment(size_t segment_number)
+{
+	auto path = segment_path(segment_number);
+	int fd = open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+	if (fd < 0)
+	{
+		throw system_error("error opening block log " + path);
+	}
+
+	struct stat st;
+	if (fstat(fd, &st) != 0)
+	{
+		close(fd);
+		throw system_error("error opening block log " + path);
+	}
+
+	// New segments are preallocated, so that the mapping covers all blocks that will be written to them.
+	// The unused rest of a segment reads as zeros, which marks the end of the records.
+	size_t size = st.st_size;
+	if (size == 0)
+	{
+		size = m_options.segment_size;
+		if (ftruncate(fd, size) != 0)
+		{
+			close(fd);
+			throw system_error("error allocating block log " + path);
+		}
+
+		// make the new file itself durable
+		int dir_fd = open(m_directory.c_str(), O_RDONLY | O_CLOEXEC);
+		if (dir_fd >= 0)
+		{
+			fsync(dir_fd);
+			close(dir_fd);
+		}
+	}
+
+	void *data = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+	if (data == MAP_FAILED)
+	{
+		close(fd);
+		throw system_error("error mapping block log " + path);
+	}
+
+	// Segments other than the last one are never written to again.
+	m_segments.push_back({fd, static_cast<uint8_t *>(data), size, 0});
+	for (size_t i = 0; i + 1 < m_segments.size(); i++)
+	{
+		m_segments[i].end = m_segments[i].size;
+	}
+}
+
+void BlockLog::open_index()
+{
+	auto path = m_directory + "/index";
+	m_index_fd = open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+	if (m_index_fd < 0)
+	{
+		throw system_error("error opening block log index " + path);
+	}
+
+	struct stat st;
+	if (fstat(m_index_fd, &st) != 0)
+	{
+		throw system_error("error opening block log index " + path);
+	}
+
+	size_t size = st.st_size;
+	bool created = size == 0;
+	if (created)
+	{
+		size = sizeof(IndexHeader) + INITIAL_INDEX_CAPACITY * sizeof(IndexEntry);
+		if (ftruncate(m_index_fd, size) != 0)
+		{
+			throw system_error("error allocating block log index " + path);
+		}
+	}
+	else if (size < sizeof(IndexHeader))
+	{
+		throw std::runtime_error(path + " is not a block log index");
+	}
+
+	m_index_capacity = (size - sizeof(IndexHeader)) / sizeof(IndexEntry);
+	void *data = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, m_index_fd, 0);
+	if (data == MAP_FAILED)
+	{
+		throw system_error("error mapping block log index " + path);
+	}
+	m_index_data = static_cast<uint8_t *>(data);
+
+	if (created)
+	{
+		index_header() = {INDEX_MAGIC, 0};
+	}
+	else if (index_header().magic != INDEX_MAGIC)
+	{
+		throw std::runtime_error(path + " is not a block log index");
+	}
+}
+
+void BlockLog::grow_index()
+{
+	size_t old_size = sizeof(IndexHeader) + m_index_capacity * sizeof(IndexEntry);
+	size_t new_size = sizeof(IndexHeader) + 2 * m_index_capacity * sizeof(IndexEntry);
+
+	if (ftruncate(m_index_fd, new_size) != 0)
+	{
+		throw system_error("error growing block log index in " + m_directory);
+	}
+
+	void *data = mremap(m_index_data, old_size, new_size, MREMAP_MAYMOVE);
+	if (data == MAP_FAILED)
+	{
+		throw system_error("error mapping block log index in " + m_directory);
+	}
+
+	m_index_data = static_cast<uint8_t *>(data);
+	m_index_capacity *= 2;
+}
+
+void BlockLog::recover_last_segment()
+{
+	auto &segment = m_segments.back();
+	uint32_t segment_number = m_segments.size() - 1;
+
+	size_t offset = 0;
+	while (offset + RECORD_HEADER_SIZE <= segment.size)
+	{
+		uint32_t size, crc;
+		std::memcpy(&size, segment.data + offset, sizeof(size));
+		std::memcpy(&crc, segment.data + offset + sizeof(size), sizeof(crc));
+
+		// the unused rest of the segment
+		if (size == 0)
+		{
+			break;
+		}
+
+		bool valid = size <= segment.size - offset - RECORD_HEADER_SIZE &&
+		             checksum(segment.data + offset + RECORD_HEADER_SIZE, size) == crc;
+
+		BlockPtr block;
+		if (valid)
+		{
+			try
+			{
+				block = BlockView{segment.data + offset + RECORD_HEADER_SIZE, size}.decode();
+			}
+			catch (const cereal::Exception &e)
+			{
+				valid = false;
+			}
+		}
+
+		if (!valid)
+		{
+			// This is most likely a write that was interrupted by a crash. Zero the rest of the segment,
+			// so that later records cannot be confused with what is left of it.
+			spdlog::warn("discarding corrupted record at offset {} of {}", offset, segment_path(segment_number));
+			if (ftruncate(segment.fd, offset) != 0 || ftruncate(segment.fd, segment.size) != 0)
+			{
+				throw system_error("error truncating block log " + segment_path(segment_number));
+			}
+			break;
+		}
+
+		add_index_entry({block->hash(), segment_number, size, offset});
+		offset += RECORD_HEADER_SIZE + size;
+	}
+
+	segment.end = offset;
+}
+
+void BlockLog::add_index_entry(const IndexEntry &entry)
+{
+	if (index_header().num_entries == m_index_capacity)
+	{
+		grow_index();
+	}
+
+	// the entry is written before it is counted
+	index_entries()[index_header().num_entries] = entry;
+	m_positions.insert(entry.hash, index_header().num_entries);
+	index_header().num_entries++;
+}
+
+uint32_t BlockLog::checksum(const uint8_t *data, size_t size)
+{
+	return crc32(*m_crc, data, size);
+}
+
+BlockView BlockLog::view(const IndexEntry &entry) const
+{
+	return {m_segments[entry.segment].data + entry.offset + RECORD_HEADER_SIZE, entry.size};
+}
+
+} // namespace HotStuff
@@ -0,0 +1,133 @@
+#pragma once
+
+#include <botan/hash.h>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "util/flat_hash_map.h"
+
+#include "blockchain.h"
+#include "types.h"
+
+namespace HotStuff
+{
+
+class BlockLogOptions
+{
+  public:
+	// Blocks are appended to segment files of this size. A block larger than a segment cannot be stored.
+	size_t segment_size = 64 * 1024 * 1024;
+};
+
+// An encoded block in the mapped log. It remains valid while the log is open.
+class BlockView
+{
+  public:
+	const uint8_t *data;
+	size_t size;
+
+	BlockPtr decode() const;
+	// These decode only the fields that lead the encoding, so that a chain can be followed without copying payloads.
+	Hash parent_hash() const;
+	Round round() const;
+};
+
+// An append-only log of blocks on disk.
+//
+// Blocks are stored in segment files, as records of a 4 byte length, a 4 byte CRC32 of the encoded block,
+// and the block in cereal's binary encoding. Segments are preallocated and memory mapped,
+// so blocks are read without copying them out of the page cache.
+// An index file maps the position of each record and is memory mapped as well.
+// Appends are only durable after sync(), so that many blocks can share a single fsync.
+//
+// On opening, the last segment is scanned to recover from a crash: a torn or corrupted record and everything after
+// it are discarded, and the index is rebuilt for that segment. Segments before it are synced when the log moves on
+// to a new segment, so they are not scanned.
+//
+// The log is not thread safe.
+class BlockLog
+{
+  public:
+	// Opens the log in the given directory, creating it if needed.
+	// Throws std::system_error if a file cannot be opened or mapped, and std::runtime_error if a file is not part of a
+	// block log.
+	BlockLog(std::string directory, BlockLogOptions options = {});
+	~BlockLog();
+
+	BlockLog(const BlockLog &) = delete;
+	BlockLog &operator=(const BlockLog &) = delete;
+
+	// Appends a block, unless it is already in the log.
+	// Returns false if the block is larger than a segment.
+	bool append(const Block &block);
+	// Makes all appended blocks durable.
+	void sync();
+
+	size_t size() const;
+	bool contains(const Hash &hash) const;
+	// Returns the number of blocks that were appended before the block, or nullopt if the block is not in the log.
+	std::optional<uint64_t> position(const Hash &hash) const;
+	std::optional<BlockView> view(const Hash &hash) const;
+	// Returns nullptr if the block is not in the log.
+	BlockPtr read(const Hash &hash) const;
+	// Calls f for each block, in the order in which they were appended, skipping the first `first` blocks.
+	void for_each(const std::function<void(BlockPtr)> &f, size_t first = 0) const;
+
+  private:
+	class Segment
+	{
+	  public:
+		int fd;
+		uint8_t *data;
+		size_t size;
+		// Offset at which the next record is written.
+		size_t end;
+	};
+
+	// The layout of the index file: a header followed by one entry per record.
+	class IndexHeader
+	{
+	  public:
+		uint64_t magic;
+		uint64_t num_entries;
+	};
+
+	class IndexEntry
+	{
+	  public:
+		Hash hash;
+		uint32_t segment;
+		uint32_t size;
+		uint64_t offset;
+	};
+
+	std::string m_directory;
+	BlockLogOptions m_options;
+	std::unique_ptr<Botan::HashFunction> m_crc;
+
+	std::vector<Segment> m_segments;
+
+	int m_index_fd = -1;
+	uint8_t *m_index_data = nullptr;
+	size_t m_index_capacity = 0; // in entries
+
+	// Position of each block in the index.
+	FlatHashMap<Hash, uint64_t> m_positions;
+
+	IndexHeader &index_header() const;
+	IndexEntry *index_entries() const;
+
+	std::string segment_path(size_t segment) const;
+	void open_segment(size_t segment);
+	void open_index();
+	void grow_index();
+	void recover_last_segment();
+	void add_index_entry(const IndexEntry &entry);
+	uint32_t checksum(const uint8_t *data, size_t size);
+	BlockView view(const IndexEntry &entry) const;
+};
+
+} // namespace HotStuff
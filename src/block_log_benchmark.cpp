@@ -0,0 +1,65 @@
+#include <catch2/benchmark/catch_benchmark.hpp>
+#include <catch2/catch_test_macros.hpp>
+#include <filesystem>
+#include <fmt/core.h>
+
+#include "block_log.h"
+#include "blockchain.h"
+#include "checkpoint.h"
+#include "tests/util.h"
+
+using namespace HotStuff;
+
+TEST_CASE("Block log", "[block_log][benchmark]")
+{
+	auto dir = std::filesystem::temp_directory_path() / "hotstuff-benchmark-block-log";
+	auto [peers, keys] = make_peers();
+	auto qc = make_qc(peers, keys);
+	const size_t num_blocks = 10'000;
+
+	for (size_t payload_size : {0, 4096})
+	{
+		std::vector<BlockPtr> blocks;
+		Hash parent = GENESIS.hash();
+		for (Round round = 1; round <= num_blocks; round++)
+		{
+			blocks.push_back(std::make_shared<const Block>(parent, round, 1, qc, std::vector<uint8_t>(payload_size)));
+			parent = blocks.back()->hash();
+		}
+
+		// with a single fsync for all blocks
+		BENCHMARK(fmt::format("append {} blocks payload={}", num_blocks, payload_size))
+		{
+			std::filesystem::remove_all(dir);
+			BlockLog log(dir);
+			for (auto &block : blocks)
+			{
+				log.append(*block);
+			}
+			log.sync();
+			return log.size();
+		};
+
+		// open the log and add all of its blocks to a fresh chain, as a restarted replica would
+		BENCHMARK(fmt::format("recover {} blocks payload={}", num_blocks, payload_size))
+		{
+			BlockLog log(dir);
+			BlockChain chain;
+			log.for_each([&](BlockPtr block) { chain.add(std::move(block)); });
+			return chain.size();
+		};
+
+		// start from a checkpoint, and only replay the blocks after it
+		Checkpoint checkpoint;
+		checkpoint.committed = blocks[num_blocks - 101]->hash();
+		checkpoint.committed_round = blocks[num_blocks - 101]->round();
+		checkpoint.log_offset = num_blocks - 101;
+		BENCHMARK(fmt::format("restore {} blocks from checkpoint payload={}", num_blocks, payload_size))
+		{
+			BlockLog log(dir);
+			return restore_chain(log, checkpoint)->size();
+		};
+	}
+
+	std::filesystem::remove_all(dir);
+}
@@ -0,0 +1,84 @@
+#include <catch2/catch_test_macros.hpp>
+#include <filesystem>
+#include <fstream>
+
+#include "block_log.h"
+#include "tests/util.h"
+
+using namespace HotStuff;
+
+TEST_CASE("Read blocks back from the log after reopening it", "[block_log]")
+{
+	TempDirectory dir;
+	BlockLogOptions options;
+	// small segments, so that the blocks are spread over several of them
+	options.segment_size = 4096;
+	auto chain = make_chain(100, 200);
+
+	{
+		BlockLog log(dir.path, options);
+		for (auto &block : chain)
+		{
+			REQUIRE(log.append(*block));
+		}
+		REQUIRE(log.append(*chain[0]));
+		REQUIRE(log.size() == chain.size());
+		REQUIRE(log.read(chain[50]->hash())->hash() == chain[50]->hash());
+		REQUIRE(!log.append(Block(GENESIS.hash(), 1, 1, GENESIS_QC, std::vector<uint8_t>(options.segment_size))));
+	}
+
+	BlockLog log(dir.path, options);
+	REQUIRE(log.size() == chain.size());
+
+	auto view = log.view(chain[10]->hash());
+	REQUIRE(view);
+	REQUIRE(view->decode()->payload() == chain[10]->payload());
+	REQUIRE(!log.view(GENESIS.hash()));
+
+	size_t i = 0;
+	log.for_each([&](BlockPtr block) { REQUIRE(block->hash() == chain[i++]->hash()); });
+	REQUIRE(i == chain.size());
+}
+
+TEST_CASE("Discard a torn record when recovering the log", "[block_log]")
+{
+	TempDirectory dir;
+	auto chain = make_chain(10, 100);
+
+	{
+		BlockLog log(dir.path);
+		for (auto &block : chain)
+		{
+			log.append(*block);
+		}
+		log.sync();
+	}
+
+	// overwrite the middle of the last block, as if the write had been interrupted
+	size_t offset;
+	{
+		BlockLog log(dir.path);
+		auto first = log.view(chain[0]->hash());
+		auto last = log.view(chain[9]->hash());
+		offset = (last->data - first->data) + last->size / 2;
+	}
+	{
+		std::fstream file(dir.path / "00000000.log", std::ios::in | std::ios::out | std::ios::binary);
+		file.seekp(offset);
+		file.write("garbage", 7);
+	}
+
+	{
+		BlockLog log(dir.path);
+		REQUIRE(log.size() == 9);
+		REQUIRE(!log.contains(chain[9]->hash()));
+		REQUIRE(log.contains(chain[8]->hash()));
+
+		// the log continues where the intact records end
+		REQUIRE(log.append(*chain[9]));
+	}
+
+	BlockLog log(dir.path);
+	REQUIRE(log.size() == 10);
+	REQUIRE(log.read(chain[9]->hash())->payload() == chain[9]->payload());
+}
@@ -1,8 +1,5 @@
-#include <botan/sha2_32.h>
-#include <cereal/archives/binary.hpp>
-#include <sstream>
-
 #include "blockchain.h"
+#include "util/hash_archive.h"
 
 namespace HotStuff
 {
@@ -12,8 +9,9 @@ Block::Block()
 }
 
 Block::Block(Hash parent, Round round, ID proposer, QuorumCert cert, std::vector<uint8_t> payload)
-    : m_parent(parent), m_round(round), m_proposer(proposer), m_cert(cert), m_payload(payload)
+    : m_parent(parent), m_round(round), m_proposer(proposer), m_cert(std::move(cert)), m_payload(std::move(payload))
 {
+	m_hash = compute_hash();
 }
 
 Hash Block::parent_hash() const
@@ -31,51 +29,214 @@ ID Block::proposer() const
 	return m_proposer;
 }
 
-QuorumCert Block::cert() const
+const QuorumCert &Block::cert() const
 {
 	return m_cert;
 }
 
-Hash Block::hash() const
+const Hash &Block::hash() const
+{
+	return m_hash;
+}
+
+Hash Block::compute_hash() const
+{
+	return sha256_of(*this);
+}
+
+const std::vector<uint8_t> &Block::payload() const
+{
+	return m_payload;
+}
+
+BlockChain::BlockChain(Round epoch_length) : BlockChain(std::make_shared<const Block>(GENESIS), epoch_length)
+{
+}
+
+BlockChain::BlockChain(BlockPtr root, Round epoch_length) : m_epoch_length(epoch_length)
+{
+	add(std::move(root));
+}
+
+const BlockChain::Entry *BlockChain::find(const Hash &hash) const
+{
+	auto entry = m_index.find(hash);
+	return entry ? *entry : nullptr;
+}
+
+BlockPtr BlockChain::get(const Hash &hash) const
 {
-	Hash hash;
-	Botan::SHA_256 hasher;
-	std::stringstream buf;
+	auto entry = find(hash);
+	return entry ? entry->block : nullptr;
+}
+
+bool BlockChain::add(BlockPtr block)
+{
+	if (m_index.count(block->hash()))
+	{
+		return true;
+	}
 
+	const Entry *parent = find(block->parent_hash());
+	// ancestor_at_round relies on rounds increasing along a chain.
+	if (parent && block->round() <= parent->block->round())
 	{
-		cereal::BinaryOutputArchive oa(buf);
-		oa(*this);
+		return false;
 	}
 
-	auto hash_vec = hasher.process(buf.str());
-	std::copy_n(hash_vec.begin(), hash.size(), hash.begin());
+	uint64_t height = parent ? parent->height + 1 : 0;
+	const Entry *skip = parent ? ancestor_at_height(parent, skip_height(height)) : nullptr;
+
+	auto &epoch = m_epochs[block->round() / m_epoch_length];
+	auto &entry = epoch.entries.emplace_back(Entry{block, parent, skip, height});
+	epoch.num_live++;
+	m_index.insert(block->hash(), &entry);
 
-	return hash;
+	return true;
 }
 
-std::vector<uint8_t> Block::payload() const
+size_t BlockChain::size() const
 {
-	return m_payload;
+	return m_index.size();
 }
 
-BlockChain::BlockChain()
+// The skip pointers follow the scheme used by Bitcoin Core (CBlockIndex::pskip), in which
+// any ancestor can be reached in O(log n) steps, while each entry stores only a single extra pointer.
+uint64_t BlockChain::skip_height(uint64_t height)
 {
-	add(GENESIS);
+	auto invert_lowest_one = [](uint64_t n) { return n & (n - 1); };
+
+	if (height < 2)
+	{
+		return 0;
+	}
+
+	return (height & 1) ? invert_lowest_one(invert_lowest_one(height - 1)) + 1 : invert_lowest_one(height);
 }
 
-std::optional<Block> BlockChain::get(Hash hash)
+const BlockChain::Entry *BlockChain::ancestor_at_height(const Entry *entry, uint64_t height)
 {
-	auto block_entry = blocks.find(hash);
-	if (block_entry == blocks.end())
+	if (entry == nullptr || height > entry->height)
 	{
-		return std::nullopt;
+		return nullptr;
 	}
-	return block_entry->second;
+
+	// entry becomes nullptr if the chain was pruned above the requested height
+	while (entry && entry->height > height)
+	{
+		uint64_t skip = skip_height(entry->height);
+		uint64_t parent_skip = skip_height(entry->height - 1);
+
+		// Take the skip pointer unless it overshoots, or the parent's skip pointer gets closer.
+		if (entry->skip &&
+		    (skip == height || (skip > height && !(parent_skip + 2 < skip && parent_skip >= height))))
+		{
+			entry = entry->skip;
+		}
+		else
+		{
+			entry = entry->parent;
+		}
+	}
+
+	return entry;
+}
+
+bool BlockChain::extends(const Hash &block, const Hash &ancestor) const
+{
+	auto block_entry = find(block);
+	auto ancestor_entry = find(ancestor);
+	if (!block_entry || !ancestor_entry)
+	{
+		return false;
+	}
+
+	return ancestor_at_height(block_entry, ancestor_entry->height) == ancestor_entry;
 }
 
-void BlockChain::add(Block block)
+BlockPtr BlockChain::ancestor_at_round(const Hash &block, Round round) const
 {
-	blocks.insert({block.hash(), block});
+	const Entry *entry = find(block);
+	if (!entry)
+	{
+		return nullptr;
+	}
+
+	if (entry->block->round() <= round)
+	{
+		return entry->block;
+	}
+
+	// Rounds increase along the chain, so this is the same walk as in ancestor_at_height, towards the lowest ancestor
+	// whose round is above the given round. An entry is at or above that height iff its round is above the round.
+	auto above = [round](const Entry *e) { return e && e->block->round() > round; };
+
+	while (above(entry->parent))
+	{
+		const Entry *parent_skip = entry->parent->skip;
+		bool parent_skip_is_closer =
+		    entry->skip && parent_skip && parent_skip->height + 2 < entry->skip->height && above(parent_skip);
+
+		if (above(entry->skip) && !parent_skip_is_closer)
+		{
+			entry = entry->skip;
+		}
+		else
+		{
+			entry = entry->parent;
+		}
+	}
+
+	return entry->parent ? entry->parent->block : nullptr;
+}
+
+bool BlockChain::prune(const Hash &committed, const std::function<void(const BlockPtr &)> &on_pruned)
+{
+	auto root_entry = m_index.find(committed);
+	if (!root_entry)
+	{
+		return false;
+	}
+	Entry *root = *root_entry;
+
+	if (on_pruned)
+	{
+		std::vector<const Entry *> ancestors;
+		for (auto ancestor = root->parent; ancestor; ancestor = ancestor->parent)
+		{
+			ancestors.push_back(ancestor);
+		}
+		for (auto ancestor = ancestors.rbegin(); ancestor != ancestors.rend(); ancestor++)
+		{
+			on_pruned((*ancestor)->block);
+		}
+	}
+
+	// Pruned entries stay in memory until the end, since the remaining entries may still point to them.
+	m_index.erase_if([&](const Hash &, Entry *entry) {
+		if (entry->height >= root->height && ancestor_at_height(entry, root->height) == root)
+		{
+			if (entry->skip && entry->skip->height < root->height)
+			{
+				entry->skip = nullptr;
+			}
+			return false;
+		}
+
+		m_epochs[entry->block->round() / m_epoch_length].num_live--;
+		entry->block.reset();
+		return true;
+	});
+
+	root->parent = nullptr;
+	root->skip = nullptr;
+
+	for (auto epoch = m_epochs.begin(); epoch != m_epochs.end();)
+	{
+		epoch = epoch->second.num_live == 0 ? m_epochs.erase(epoch) : std::next(epoch);
+	}
+
+	return true;
 }
 
 } // namespace HotStuff
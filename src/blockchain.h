@@ -1,8 +1,12 @@
 #pragma once
 
 #include <cereal/access.hpp>
-#include <optional>
-#include <unordered_map>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+
+#include "util/flat_hash_map.h"
 
 #include "crypto.h"
 #include "types.h"
@@ -21,9 +25,11 @@ class Block
 	Hash parent_hash() const;
 	Round round() const;
 	ID proposer() const;
-	QuorumCert cert() const;
-	Hash hash() const;
-	std::vector<uint8_t> payload() const;
+	const QuorumCert &cert() const;
+	// Returns the hash of the block.
+	// Blocks are immutable, so the hash is computed once on construction/deserialization and cached.
+	const Hash &hash() const;
+	const std::vector<uint8_t> &payload() const;
 
   private:
 	friend class cereal::access;
@@ -33,23 +39,82 @@ class Block
 	ID m_proposer;
 	QuorumCert m_cert;
 	std::vector<uint8_t> m_payload;
+	Hash m_hash{};
+
+	Hash compute_hash() const;
+
+	template <class Archive> void save(Archive &archive) const
+	{
+		archive(m_parent, m_round, m_proposer, m_cert, m_payload);
+	}
 
-	template <class Archive> void serialize(Archive &archive)
+	template <class Archive> void load(Archive &archive)
 	{
-		archive(m_parent, m_round, m_proposer, m_cert);
+		archive(m_parent, m_round, m_proposer, m_cert, m_payload);
+		m_hash = compute_hash();
 	}
 };
 
+// Blocks are shared between the network, the blockchain and consensus instead of being copied.
+typedef std::shared_ptr<const Block> BlockPtr;
+
 const Block GENESIS(Hash(), 0, 0, GENESIS_QC);
 
+// Stores blocks along with links to their parents, so that ancestry queries take O(log n) steps.
+// Blocks should be added parents first. A block whose parent is unknown is the root of a new chain.
 class BlockChain
 {
-	std::unordered_map<Hash, Block> blocks;
-
   public:
-	BlockChain();
-	std::optional<Block> get(Hash hash);
-	void add(Block block);
+	// The index entries of blocks are allocated in epochs of epoch_length rounds,
+	// and each epoch is freed in one go once all of its blocks have been pruned.
+	BlockChain(Round epoch_length = 1024);
+	// Creates a chain that starts at the given block instead of GENESIS, e.g. when restoring from a checkpoint.
+	BlockChain(BlockPtr root, Round epoch_length = 1024);
+	// Returns nullptr if the block is not known.
+	BlockPtr get(const Hash &hash) const;
+	// Returns false if the block was not added because its round is not greater than its parent's.
+	bool add(BlockPtr block);
+	// Returns the number of blocks that are stored.
+	size_t size() const;
+
+	// Returns true if ancestor is block itself or one of its ancestors.
+	bool extends(const Hash &block, const Hash &ancestor) const;
+	// Returns the ancestor of block (or block itself) with the highest round that is at most round.
+	// Returns nullptr if there is no such block among the known ancestors.
+	BlockPtr ancestor_at_round(const Hash &block, Round round) const;
+
+	// Drops all blocks that do not extend the committed block, which becomes the root of the chain.
+	// Its ancestors are passed to on_pruned first, oldest first, e.g. to write them to disk.
+	// Returns false if the committed block is not known.
+	bool prune(const Hash &committed, const std::function<void(const BlockPtr &)> &on_pruned = {});
+
+  private:
+	class Entry
+	{
+	  public:
+		BlockPtr block;
+		const Entry *parent;
+		// An ancestor further up the chain. See skip_height().
+		const Entry *skip;
+		// Distance to the first block of the chain. Heights do not change when blocks are pruned.
+		uint64_t height;
+	};
+
+	class Epoch
+	{
+	  public:
+		// A deque never moves its elements, and allocates them in chunks.
+		std::deque<Entry> entries;
+		size_t num_live = 0;
+	};
+
+	Round m_epoch_length;
+	std::map<Round, Epoch> m_epochs;
+	FlatHashMap<Hash, Entry *> m_index;
+
+	const Entry *find(const Hash &hash) const;
+	static uint64_t skip_height(uint64_t height);
+	static const Entry *ancestor_at_height(const Entry *entry, uint64_t height);
 };
 
 } // namespace HotStuff
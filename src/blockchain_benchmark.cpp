@@ -0,0 +1,152 @@
+#include <botan/sha2_32.h>
+#include <catch2/benchmark/catch_benchmark.hpp>
+#include <catch2/catch_test_macros.hpp>
+#include <cereal/archives/binary.hpp>
+#include <fmt/core.h>
+#include <random>
+#include <sstream>
+#include <unordered_map>
+
+#include "blockchain.h"
+#include "tests/util.h"
+#include "util/flat_hash_map.h"
+#include "util/hash_archive.h"
+
+using namespace HotStuff;
+
+// Hashes a block the way it was done before HashArchive: serialize into a stringstream, then hash a copy of it.
+static Hash hash_via_stringstream(const Block &block)
+{
+	Hash hash;
+	Botan::SHA_256 hasher;
+	std::stringstream buf;
+
+	{
+		cereal::BinaryOutputArchive oa(buf);
+		oa(block);
+	}
+
+	auto hash_vec = hasher.process(buf.str());
+	std::copy_n(hash_vec.begin(), hash.size(), hash.begin());
+
+	return hash;
+}
+
+TEST_CASE("Hash block", "[blockchain][benchmark]")
+{
+	auto [peers, keys] = make_peers();
+	auto qc = make_qc(peers, keys);
+
+	for (size_t payload_size : {0, 1024, 1024 * 1024})
+	{
+		Block block(GENESIS.hash(), 1, 1, qc, std::vector<uint8_t>(payload_size, 7));
+
+		BENCHMARK(fmt::format("stringstream payload={}", payload_size))
+		{
+			return hash_via_stringstream(block);
+		};
+
+		BENCHMARK(fmt::format("hash archive payload={}", payload_size))
+		{
+			return sha256_of(block);
+		};
+	}
+}
+
+TEST_CASE("Ancestor queries", "[blockchain][benchmark]")
+{
+	for (Round length : {100'000, 1'000'000})
+	{
+		BlockChain bc;
+		Hash tip = GENESIS.hash();
+		for (Round round = 1; round <= length; round++)
+		{
+			auto block = std::make_shared<const Block>(tip, round, 1, GENESIS_QC);
+			tip = block->hash();
+			bc.add(std::move(block));
+		}
+
+		// the old safety check: one lookup per ancestor until the locked round is reached
+		BENCHMARK(fmt::format("linear walk n={}", length))
+		{
+			auto ancestor = bc.get(tip);
+			while (ancestor && ancestor->round() > 1)
+			{
+				ancestor = bc.get(ancestor->parent_hash());
+			}
+			return ancestor;
+		};
+
+		BENCHMARK(fmt::format("ancestor_at_round n={}", length))
+		{
+			return bc.ancestor_at_round(tip, 1);
+		};
+
+		BENCHMARK(fmt::format("extends n={}", length))
+		{
+			return bc.extends(tip, GENESIS.hash());
+		};
+	}
+}
+
+TEST_CASE("Hash map", "[blockchain][benchmark]")
+{
+	std::mt19937_64 rng(1);
+
+	for (size_t n : {10'000, 100'000, 1'000'000, 10'000'000})
+	{
+		// random keys, like block hashes
+		std::vector<Hash> keys(n);
+		for (auto &key : keys)
+		{
+			for (auto &byte : key)
+			{
+				byte = static_cast<uint8_t>(rng());
+			}
+		}
+
+		std::unordered_map<Hash, uint64_t> unordered_map;
+		FlatHashMap<Hash, uint64_t> flat_map;
+
+		BENCHMARK(fmt::format("unordered_map insert n={}", n))
+		{
+			unordered_map.clear();
+			for (size_t i = 0; i < n; i++)
+			{
+				unordered_map.insert({keys[i], i});
+			}
+			return unordered_map.size();
+		};
+
+		BENCHMARK(fmt::format("FlatHashMap insert n={}", n))
+		{
+			flat_map.clear();
+			for (size_t i = 0; i < n; i++)
+			{
+				flat_map.insert(keys[i], i);
+			}
+			return flat_map.size();
+		};
+
+		// the insert benchmarks leave the maps filled
+		BENCHMARK(fmt::format("unordered_map lookup n={}", n))
+		{
+			uint64_t sum = 0;
+			for (auto &key : keys)
+			{
+				sum += unordered_map.find(key)->second;
+			}
+			return sum;
+		};
+
+		BENCHMARK(fmt::format("FlatHashMap lookup n={}", n))
+		{
+			uint64_t sum = 0;
+			for (auto &key : keys)
+			{
+				sum += *flat_map.find(key);
+			}
+			return sum;
+		};
+	}
+}
@@ -1,9 +1,14 @@
+#include <algorithm>
+#include <botan/sha2_32.h>
 #include <catch2/catch_test_macros.hpp>
+#include <cstring>
 #include <cereal/archives/binary.hpp>
 #include <sstream>
 
 #include "blockchain.h"
 #include "tests/util.h"
+#include "util/buffer_archive.h"
+#include "util/hash_archive.h"
 
 using namespace HotStuff;
 
@@ -13,9 +18,95 @@ TEST_CASE("Get Genesis", "[blockchain]")
 
 	auto block = bc.get(GENESIS.hash());
 
-	REQUIRE(block.has_value());
+	REQUIRE(block);
 
-	REQUIRE(block.value().hash() == GENESIS.hash());
+	REQUIRE(block->hash() == GENESIS.hash());
+	// lookups share the stored block instead of copying it
+	REQUIRE(bc.get(GENESIS.hash()) == block);
+	REQUIRE(bc.get(Hash{1}) == nullptr);
+}
+
+TEST_CASE("Ancestor queries", "[blockchain]")
+{
+	BlockChain bc;
+
+	// a chain with gaps between rounds, and a fork at round 500
+	std::vector<BlockPtr> chain = {bc.get(GENESIS.hash())};
+	for (Round round = 1; round < 2000; round += 1 + round % 3)
+	{
+		chain.push_back(std::make_shared<const Block>(chain.back()->hash(), round, 1, GENESIS_QC));
+		REQUIRE(bc.add(chain.back()));
+	}
+
+	auto fork_point = bc.ancestor_at_round(chain.back()->hash(), 500);
+	REQUIRE(fork_point);
+	auto fork = std::make_shared<const Block>(fork_point->hash(), 5000, 2, GENESIS_QC);
+	REQUIRE(bc.add(fork));
+
+	// rounds must increase along a chain
+	REQUIRE(!bc.add(std::make_shared<const Block>(fork->hash(), 4000, 2, GENESIS_QC)));
+
+	for (size_t i = 0; i < chain.size(); i += 7)
+	{
+		REQUIRE(bc.extends(chain.back()->hash(), chain[i]->hash()));
+		REQUIRE(!bc.extends(chain[i]->hash(), chain.back()->hash()));
+		REQUIRE(bc.extends(fork->hash(), chain[i]->hash()) == (chain[i]->round() <= fork_point->round()));
+
+		for (Round round : {chain[i]->round(), chain[i]->round() + 1})
+		{
+			// the last block whose round is at most round
+			auto expected = *std::prev(std::upper_bound(chain.begin(), chain.end(), round,
+			                                            [](Round r, const BlockPtr &b) { return r < b->round(); }));
+			REQUIRE(bc.ancestor_at_round(chain.back()->hash(), round) == expected);
+		}
+	}
+
+	REQUIRE(bc.ancestor_at_round(fork->hash(), 4999) == fork_point);
+	REQUIRE(!bc.extends(chain.back()->hash(), Hash{1}));
+}
+
+TEST_CASE("Prune blocks that do not extend the committed block", "[blockchain]")
+{
+	BlockChain bc(16);
+
+	std::vector<BlockPtr> chain = {bc.get(GENESIS.hash())};
+	for (Round round = 1; round <= 100; round++)
+	{
+		chain.push_back(std::make_shared<const Block>(chain.back()->hash(), round, 1, GENESIS_QC));
+		REQUIRE(bc.add(chain.back()));
+	}
+
+	// forks below and above the committed block at round 60
+	auto old_fork = std::make_shared<const Block>(chain[30]->hash(), 31, 2, GENESIS_QC);
+	auto new_fork = std::make_shared<const Block>(chain[70]->hash(), 71, 2, GENESIS_QC);
+	auto stale_fork = std::make_shared<const Block>(chain[59]->hash(), 61, 2, GENESIS_QC);
+	REQUIRE(bc.add(old_fork));
+	REQUIRE(bc.add(new_fork));
+	REQUIRE(bc.add(stale_fork));
+
+	std::vector<BlockPtr> pruned;
+	REQUIRE(bc.prune(chain[60]->hash(), [&](const BlockPtr &block) { pruned.push_back(block); }));
+
+	// the ancestors of the committed block are handed out oldest first, the forks are just dropped
+	REQUIRE(pruned == std::vector<BlockPtr>(chain.begin(), chain.begin() + 60));
+	REQUIRE(bc.size() == 41 + 1);
+	REQUIRE(!bc.get(GENESIS.hash()));
+	REQUIRE(!bc.get(old_fork->hash()));
+	REQUIRE(!bc.get(stale_fork->hash()));
+	REQUIRE(bc.get(new_fork->hash()) == new_fork);
+
+	REQUIRE(bc.extends(chain.back()->hash(), chain[60]->hash()));
+	REQUIRE(bc.extends(new_fork->hash(), chain[65]->hash()));
+	REQUIRE(!bc.extends(chain.back()->hash(), chain[59]->hash()));
+	REQUIRE(bc.ancestor_at_round(chain.back()->hash(), 75) == chain[75]);
+	REQUIRE(bc.ancestor_at_round(chain.back()->hash(), 30) == nullptr);
+
+	// the chain keeps growing from the new root
+	auto next = std::make_shared<const Block>(chain.back()->hash(), 101, 1, GENESIS_QC);
+	REQUIRE(bc.add(next));
+	REQUIRE(bc.extends(next->hash(), chain[60]->hash()));
+
+	REQUIRE(!bc.prune(GENESIS.hash()));
 }
 
 TEST_CASE("Serialize/Deserialize Block", "[serialization]")
@@ -40,4 +131,86 @@ TEST_CASE("Serialize/Deserialize Block", "[serialization]")
 	}
 
 	REQUIRE(block1.hash() == block2.hash());
+	REQUIRE(block1.payload() == block2.payload());
+}
+
+TEST_CASE("Block hash depends on contents", "[blockchain]")
+{
+	auto genesis_hash = GENESIS.hash();
+
+	Block block1(genesis_hash, 1, 1, GENESIS_QC);
+	Block block2(genesis_hash, 2, 1, GENESIS_QC);
+	Block block3(genesis_hash, 1, 1, GENESIS_QC, {1, 2, 3});
+	Block copy = block1;
+
+	REQUIRE(block1.hash() != block2.hash());
+	REQUIRE(block1.hash() != block3.hash());
+	REQUIRE(copy.hash() == block1.hash());
+}
+
+TEST_CASE("Buffer archives use the cereal binary encoding", "[serialization]")
+{
+	auto [peers, keys] = make_peers();
+	auto qc = make_qc(peers, keys);
+
+	Block block1(GENESIS.hash(), 1, 1, qc);
+	Block block2;
+
+	std::stringstream ss;
+
+	{
+		cereal::BinaryOutputArchive oarchive(ss);
+		oarchive(block1);
+	}
+
+	auto buf = serialize_to_buffer(block1);
+	auto expected = ss.str();
+
+	REQUIRE(buf == std::vector<uint8_t>(expected.begin(), expected.end()));
+
+	{
+		BufferInputArchive iarchive(buf);
+		iarchive(block2);
+	}
+
+	REQUIRE(block1.hash() == block2.hash());
+
+	buf.pop_back();
+	BufferInputArchive truncated(buf);
+	REQUIRE_THROWS_AS(truncated(block2), cereal::Exception);
+}
+
+TEST_CASE("Reject a size tag that exceeds the buffer", "[serialization]")
+{
+	Block block(GENESIS.hash(), 1, 1, GENESIS_QC, std::vector<uint8_t>(16));
+	auto buf = serialize_to_buffer(block);
+
+	// the payload comes last, after its size tag
+	uint64_t forged = uint64_t(1) << 60;
+	std::memcpy(buf.data() + buf.size() - 16 - sizeof(forged), &forged, sizeof(forged));
+
+	Block decoded;
+	BufferInputArchive iarchive(buf);
+	REQUIRE_THROWS_AS(iarchive(decoded), cereal::Exception);
+}
+
+TEST_CASE("Hash archive hashes the cereal binary encoding", "[serialization]")
+{
+	auto [peers, keys] = make_peers();
+	Block block(GENESIS.hash(), 1, 1, make_qc(peers, keys), std::vector<uint8_t>(1000, 7));
+
+	std::stringstream ss;
+
+	{
+		cereal::BinaryOutputArchive oarchive(ss);
+		oarchive(block);
+	}
+
+	Hash expected;
+	Botan::SHA_256 hasher;
+	auto digest = hasher.process(ss.str());
+	std::copy_n(digest.begin(), expected.size(), expected.begin());
+
+	REQUIRE(sha256_of(block) == expected);
+	REQUIRE(block.hash() == expected);
 }
@@ -0,0 +1,222 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <filesystem>
+#include <fmt/core.h>
+#include <spdlog/spdlog.h>
+#include <system_error>
+#include <unistd.h>
+
+#include "checkpoint.h"
+#include "util/buffer_archive.h"
+#include "util/crc32.h"
+
+const uint64_t CHECKPOINT_MAGIC = 0x74706b6368747368; // "hstchkpt"
+const char *CHECKPOINT_PREFIX = "checkpoint-";
+
+namespace HotStuff
+{
+
+// The layout of a checkpoint file: a header, followed by the encoded checkpoint.
+class CheckpointHeader
+{
+  public:
+	uint64_t magic;
+	uint32_t size;
+	uint32_t checksum;
+};
+
+static std::system_error system_error(const std::string &what)
+{
+	return std::system_error(errno, std::generic_category(), what);
+}
+
+static void sync_path(const std::string &path, int flags)
+{
+	int fd = open(path.c_str(), flags | O_CLOEXEC);
+	if (fd < 0 || fsync(fd) != 0)
+	{
+		auto error = system_error("error syncing " + path);
+		if (fd >= 0)
+		{
+			close(fd);
+		}
+		throw error;
+	}
+	close(fd);
+}
+
+CheckpointStore::CheckpointStore(std::string directory, CheckpointOptions options)
+    : m_directory(std::move(directory)), m_options(options)
+{
+	std::filesystem::create_directories(m_directory);
+
+	auto rounds = checkpoint_rounds();
+	if (!rounds.empty())
+	{
+		m_last_round = rounds.front();
+	}
+}
+
+bool CheckpointStore::due(Round committed_round) const
+{
+	return !m_last_round || committed_round >= *m_last_round + m_options.interval;
+}
+
+void CheckpointStore::write(const Checkpoint &checkpoint)
+{
+	auto data = serialize_to_buffer(checkpoint, sizeof(CheckpointHeader));
+	CheckpointHeader header{CHECKPOINT_MAGIC, static_cast<uint32_t>(data.size() - sizeof(CheckpointHeader)),
+	                        crc32(data.data() + sizeof(CheckpointHeader), data.size() - sizeof(CheckpointHeader))};
+	std::memcpy(data.data(), &header, sizeof(header));
+
+	auto tmp_path = m_directory + "/checkpoint.tmp";
+	int fd = open(tmp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	if (fd < 0)
+	{
+		throw system_error("error creating " + tmp_path);
+	}
+
+	for (size_t written = 0; written < data.size();)
+	{
+		ssize_t n = ::write(fd, data.data() + written, data.size() - written);
+		if (n < 0 && errno != EINTR)
+		{
+			auto error = system_error("error writing " + tmp_path);
+			close(fd);
+			throw error;
+		}
+		written += std::max<ssize_t>(n, 0);
+	}
+
+	if (fsync(fd) != 0)
+	{
+		auto error = system_error("error syncing " + tmp_path);
+		close(fd);
+		throw error;
+	}
+	close(fd);
+
+	auto path = checkpoint_path(checkpoint.committed_round);
+	if (rename(tmp_path.c_str(), path.c_str()) != 0)
+	{
+		throw system_error("error renaming " + tmp_path);
+	}
+	sync_path(m_directory, O_RDONLY);
+	m_last_round = checkpoint.committed_round;
+
+	auto rounds = checkpoint_rounds();
+	for (size_t i = m_options.num_kept; i < rounds.size(); i++)
+	{
+		std::filesystem::remove(checkpoint_path(rounds[i]));
+	}
+}
+
+std::optional<Checkpoint> CheckpointStore::load_latest() const
+{
+	for (Round round : checkpoint_rounds())
+	{
+		auto path = checkpoint_path(round);
+		std::vector<uint8_t> data(std::filesystem::file_size(path));
+
+		int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+		if (fd < 0)
+		{
+			throw system_error("error opening " + path);
+		}
+		ssize_t n = pread(fd, data.data(), data.size(), 0);
+		close(fd);
+
+		CheckpointHeader header;
+		if (n < static_cast<ssize_t>(sizeof(header)))
+		{
+			spdlog::warn("skipping truncated checkpoint {}", path);
+			continue;
+		}
+		std::memcpy(&header, data.data(), sizeof(header));
+		const uint8_t *body = data.data() + sizeof(header);
+
+		if (header.magic != CHECKPOINT_MAGIC || header.size != n - sizeof(header) ||
+		    crc32(body, header.size) != header.checksum)
+		{
+			spdlog::warn("skipping corrupted checkpoint {}", path);
+			continue;
+		}
+
+		try
+		{
+			Checkpoint checkpoint;
+			BufferInputArchive iarchive(body, header.size);
+			iarchive(checkpoint);
+			return checkpoint;
+		}
+		catch (const cereal::Exception &e)
+		{
+			spdlog::warn("skipping corrupted checkpoint {}: {}", path, e.what());
+		}
+	}
+
+	return std::nullopt;
+}
+
+std::vector<Round> CheckpointStore::checkpoint_rounds() const
+{
+	std::vector<Round> rounds;
+
+	for (auto &entry : std::filesystem::directory_iterator(m_directory))
+	{
+		auto name = entry.path().filename().string();
+		if (name.rfind(CHECKPOINT_PREFIX, 0) != 0 || name.size() == std::strlen(CHECKPOINT_PREFIX))
+		{
+			continue;
+		}
+
+		try
+		{
+			size_t end;
+			Round round = std::stoull(name.substr(std::strlen(CHECKPOINT_PREFIX)), &end);
+			if (end == name.size() - std::strlen(CHECKPOINT_PREFIX))
+			{
+				rounds.push_back(round);
+			}
+		}
+		catch (const std::logic_error &e)
+		{
+			// not a checkpoint
+		}
+	}
+
+	std::sort(rounds.rbegin(), rounds.rend());
+	return rounds;
+}
+
+std::string CheckpointStore::checkpoint_path(Round round) const
+{
+	return fmt::format("{}/{}{:020}", m_directory, CHECKPOINT_PREFIX, round);
+}
+
+std::unique_ptr<BlockChain> restore_chain(const BlockLog &log, const std::optional<Checkpoint> &checkpoint)
+{
+	BlockPtr root;
+	if (!checkpoint || checkpoint->committed == GENESIS.hash())
+	{
+		root = std::make_shared<const Block>(GENESIS);
+	}
+	else
+	{
+		root = log.read(checkpoint->committed);
+		if (!root)
+		{
+			spdlog::error("committed block of checkpoint at round {} is not in the block log",
+			              checkpoint->committed_round);
+			return nullptr;
+		}
+	}
+
+	auto chain = std::make_unique<BlockChain>(std::move(root));
+	log.for_each([&](BlockPtr block) { chain->add(std::move(block)); }, checkpoint ? checkpoint->log_offset : 0);
+	return chain;
+}
+
+} // namespace HotStuff
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <memory>
+#include <optional>
+#include <string>
+
+#include "block_log.h"
+#include "blockchain.h"
+#include "crypto.h"
+#include "safety_log.h"
+#include "types.h"
+
+namespace HotStuff
+{
+
+// Everything a replica needs to start up without replaying the chain from GENESIS.
+class Checkpoint
+{
+  public:
+	Hash committed{};
+	Round committed_round = 0;
+	QuorumCert high_qc;
+	SafetyState safety;
+	// Digest of the application state after executing the committed block.
+	Hash state_root{};
+	// Position of the committed block in the block log (see BlockLog::position), or 0 for GENESIS. The log is
+	// replayed from there, so the blocks that were logged after the committed block are restored even if they were
+	// logged before the checkpoint was taken.
+	uint64_t log_offset = 0;
+
+	template <class Archive> void serialize(Archive &archive)
+	{
+		archive(committed, committed_round, high_qc, safety, state_root, log_offset);
+	}
+};
+
+class CheckpointOptions
+{
+  public:
+	// A checkpoint is due when the committed round has advanced by this many rounds since the last one.
+	Round interval = 1000;
+	// Number of checkpoint files to keep. Older ones are a fallback in case the newest one is damaged.
+	size_t num_kept = 2;
+};
+
+// Checkpoint files in a directory, one per checkpoint, named after the committed round.
+// Each file holds a checksummed encoding of the checkpoint. It is written to a temporary file first,
+// and renamed once it is on disk, so a crash never leaves a partial checkpoint behind.
+class CheckpointStore
+{
+  public:
+	// Throws std::system_error if the directory cannot be created.
+	CheckpointStore(std::string directory, CheckpointOptions options = {});
+
+	// Returns true if a checkpoint should be taken at this committed round.
+	bool due(Round committed_round) const;
+	// Throws std::system_error if the checkpoint cannot be written.
+	void write(const Checkpoint &checkpoint);
+	// Returns the newest checkpoint that can be read, if any.
+	std::optional<Checkpoint> load_latest() const;
+
+  private:
+	std::string m_directory;
+	CheckpointOptions m_options;
+	std::optional<Round> m_last_round;
+
+	// Returns the rounds of the checkpoint files, newest first.
+	std::vector<Round> checkpoint_rounds() const;
+	std::string checkpoint_path(Round round) const;
+};
+
+// Rebuilds the chain from a checkpoint, by starting at its committed block and replaying only the blocks that were
+// appended to the log after it. Without a checkpoint, the whole log is replayed on top of GENESIS.
+// Returns nullptr if the committed block of the checkpoint is not in the log.
+std::unique_ptr<BlockChain> restore_chain(const BlockLog &log, const std::optional<Checkpoint> &checkpoint);
+
+} // namespace HotStuff
@@ -0,0 +1,123 @@
+#include <catch2/catch_test_macros.hpp>
+#include <filesystem>
+#include <fmt/core.h>
+#include <fstream>
+
+#include "checkpoint.h"
+#include "tests/util.h"
+
+using namespace HotStuff;
+
+static Checkpoint make_checkpoint(const Block &committed, uint64_t log_offset)
+{
+	Checkpoint checkpoint;
+	checkpoint.committed = committed.hash();
+	checkpoint.committed_round = committed.round();
+	checkpoint.high_qc = GENESIS_QC;
+	checkpoint.safety.voted = committed.round() + 2;
+	checkpoint.safety.locked_round = committed.round() + 1;
+	checkpoint.state_root.fill(static_cast<uint8_t>(committed.round()));
+	checkpoint.log_offset = log_offset;
+	return checkpoint;
+}
+
+TEST_CASE("Write and load checkpoints", "[checkpoint]")
+{
+	TempDirectory dir;
+	auto chain = make_chain(30);
+	CheckpointOptions options;
+	options.interval = 10;
+
+	{
+		CheckpointStore store(dir.path, options);
+		REQUIRE(!store.load_latest());
+		REQUIRE(store.due(1));
+
+		store.write(make_checkpoint(*chain[0], 0));
+		REQUIRE(!store.due(10));
+		REQUIRE(store.due(11));
+		store.write(make_checkpoint(*chain[10], 10));
+		store.write(make_checkpoint(*chain[20], 20));
+	}
+
+	CheckpointStore store(dir.path, options);
+	REQUIRE(!store.due(30));
+
+	auto checkpoint = store.load_latest();
+	REQUIRE(checkpoint);
+	REQUIRE(checkpoint->committed == chain[20]->hash());
+	REQUIRE(checkpoint->committed_round == 21);
+	REQUIRE(checkpoint->safety == make_checkpoint(*chain[20], 20).safety);
+	REQUIRE(checkpoint->state_root == make_checkpoint(*chain[20], 20).state_root);
+	REQUIRE(checkpoint->log_offset == 20);
+
+	// only the newest two are kept
+	size_t num_files = 0;
+	for (auto &entry : std::filesystem::directory_iterator(dir.path))
+	{
+		(void)entry;
+		num_files++;
+	}
+	REQUIRE(num_files == 2);
+}
+
+TEST_CASE("Fall back to an older checkpoint if the newest is damaged", "[checkpoint]")
+{
+	TempDirectory dir;
+	auto chain = make_chain(20);
+
+	{
+		CheckpointStore store(dir.path);
+		store.write(make_checkpoint(*chain[4], 4));
+		store.write(make_checkpoint(*chain[14], 14));
+	}
+	{
+		std::fstream file(dir.path / fmt::format("checkpoint-{:020}", 15),
+		                  std::ios::in | std::ios::out | std::ios::binary);
+		file.seekp(20);
+		file.write("garbage", 7);
+	}
+
+	CheckpointStore store(dir.path);
+	auto checkpoint = store.load_latest();
+	REQUIRE(checkpoint);
+	REQUIRE(checkpoint->committed == chain[4]->hash());
+}
+
+TEST_CASE("Restore the chain from a checkpoint and the tail of the block log", "[checkpoint]")
+{
+	TempDirectory dir;
+	auto chain = make_chain(100);
+	BlockLog log(dir.path / "blocks");
+	for (auto &block : chain)
+	{
+		log.append(*block);
+	}
+
+	SECTION("Without a checkpoint")
+	{
+		auto restored = restore_chain(log, std::nullopt);
+		REQUIRE(restored);
+		REQUIRE(restored->size() == chain.size() + 1);
+		REQUIRE(restored->extends(chain[99]->hash(), GENESIS.hash()));
+	}
+
+	SECTION("With a checkpoint")
+	{
+		// the blocks after the committed one were logged, but not yet committed, when the checkpoint was taken
+		REQUIRE(log.position(chain[89]->hash()) == 89);
+		auto restored = restore_chain(log, make_checkpoint(*chain[89], 89));
+		REQUIRE(restored);
+		// the committed block and the ten blocks after it
+		REQUIRE(restored->size() == 11);
+		REQUIRE(restored->get(chain[89]->hash()));
+		REQUIRE(!restored->get(chain[88]->hash()));
+		REQUIRE(restored->extends(chain[99]->hash(), chain[89]->hash()));
+	}
+
+	SECTION("With a checkpoint whose committed block is missing")
+	{
+		Block unknown(GENESIS.hash(), 200, 1, GENESIS_QC, std::vector<uint8_t>());
+		REQUIRE(!restore_chain(log, make_checkpoint(unknown, 100)));
+	}
+}
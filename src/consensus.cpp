@@ -1,77 +1,382 @@
+#include <algorithm>
+#include <asio/post.hpp>
 #include <iostream>
-#include <optional>
+#include <stdexcept>
 
 #include "consensus.h"
 
 namespace HotStuff
 {
 
-LeaderElection::LeaderElection(int num_replicas) : m_num_replicas(num_replicas)
+Consensus::Consensus(asio::io_context &io_context, ID id, std::shared_ptr<Crypto> crypto, int num_replicas,
+                     std::shared_ptr<Network> network, std::shared_ptr<SafetyLog> safety_log,
+                     std::shared_ptr<Mempool> mempool, std::shared_ptr<BlockLog> block_log,
+                     std::shared_ptr<CheckpointStore> checkpoints, ConsensusOptions options)
+    : m_io_context(io_context), m_id(id), m_num_replicas(num_replicas),
+      // any two quorums share at least one correct replica, and the correct replicas form a quorum on their own
+      m_quorum_size(num_replicas - (num_replicas - 1) / 3), m_crypto(crypto),
+      m_leader_election(std::make_shared<LeaderElection>(num_replicas, options.leader_election)),
+      m_synchronizer(std::make_shared<Synchronizer>(io_context, crypto, m_quorum_size, options.synchronizer)),
+      m_network(network), m_votes(std::make_shared<VoteAggregator>(crypto, m_quorum_size, options.votes)),
+      m_mempool(mempool), m_proposal_timer(io_context), m_safety_log(safety_log), m_block_log(block_log),
+      m_checkpoints(checkpoints)
 {
+	// A replica that restarts rebuilds its chain from the block log, starting at the latest checkpoint.
+	std::optional<Checkpoint> checkpoint;
+	if (m_block_log && m_checkpoints)
+	{
+		checkpoint = m_checkpoints->load_latest();
+	}
+	m_blockchain = m_block_log ? restore_chain(*m_block_log, checkpoint) : std::make_shared<BlockChain>();
+	if (!m_blockchain)
+	{
+		throw std::runtime_error("the committed block of the checkpoint is not in the block log");
+	}
+	auto root = m_blockchain->get(checkpoint ? checkpoint->committed : GENESIS.hash());
+	m_rules = std::make_shared<SafetyRules>(m_blockchain, root, options.commit_rule);
+
+	std::vector<ID> peers;
+	for (ID peer = 0; peer < static_cast<ID>(num_replicas); peer++)
+	{
+		if (peer != id)
+		{
+			peers.push_back(peer);
+		}
+	}
+	m_fetcher =
+	    std::make_shared<BlockFetcher>(io_context, id, m_blockchain, network, peers, m_block_log, options.fetcher);
+
+	// Without the voted round and the lock from before a restart, the replica could vote against its earlier votes.
+	// The safety log is persisted before each checkpoint is written, so its state is never older than theirs.
+	auto state = m_safety_log ? m_safety_log->recovered() : std::nullopt;
+	if (!state && checkpoint)
+	{
+		state = checkpoint->safety;
+	}
+	if (state)
+	{
+		if (!m_rules->restore(*state, checkpoint ? checkpoint->high_qc : GENESIS_QC))
+		{
+			throw std::runtime_error("the safety state refers to blocks that are not in the chain");
+		}
+		m_synchronizer->update(m_rules->high_qc());
+	}
 }
 
-ID LeaderElection::get_leader(Round round)
+void Consensus::start()
 {
-	return (ID)round % m_num_replicas;
+	// The network outlives the consensus' callbacks, so they must not keep the consensus alive.
+	m_network->on_propose([weak = weak_from_this()](BlockPtr block) {
+		if (auto self = weak.lock())
+		{
+			self->on_propose(std::move(block));
+		}
+	});
+	m_network->on_vote([weak = weak_from_this()](Vote vote) {
+		if (auto self = weak.lock())
+		{
+			self->on_vote(vote);
+		}
+	});
+	m_network->on_timeout([weak = weak_from_this()](Timeout timeout) {
+		if (auto self = weak.lock())
+		{
+			self->on_timeout(timeout);
+		}
+	});
+	m_fetcher->start();
+
+	m_synchronizer->on_round([this](Round round) {
+		// The votes of the previous round may still form its QC, but earlier rounds are over. Without this, rounds
+		// that end in a timeout would leave the aggregator's window behind, until it drops all votes.
+		m_votes->advance(round - 1);
+		if (m_leader_election->get_leader(round) == m_id)
+		{
+			propose(round);
+		}
+	});
+	// The timeout must be on disk before it is signed, or the replica could vote in the round after a crash.
+	m_synchronizer->before_timeout([this](Round round) {
+		m_rules->timeout(round);
+		if (m_safety_log)
+		{
+			persist_blocks();
+			m_safety_log->persist_sync(safety_state());
+		}
+	});
+	m_synchronizer->on_timeout([this](Timeout timeout) {
+		for (ID peer = 0; peer < static_cast<ID>(m_num_replicas); peer++)
+		{
+			if (peer != m_id)
+			{
+				m_network->send_timeout(peer, timeout);
+			}
+		}
+	});
+	m_synchronizer->start();
+
+	if (m_leader_election->get_leader(m_synchronizer->round()) == m_id)
+	{
+		propose(m_synchronizer->round());
+	}
+}
+
+void Consensus::stop()
+{
+	m_synchronizer->stop();
+	m_proposal_timer.cancel();
 }
 
-void Consensus::on_propose(Block block)
+void Consensus::propose(Round round)
 {
-	if (auto result = m_crypto->verify(block.cert(), 3))
+	// An empty mempool does not hold up the round, and neither does one whose payload is ready. Otherwise, the
+	// proposal waits for the oldest transaction's deadline, but for no more than half the round's timeout, so that it
+	// still reaches the replicas in time.
+	auto now = Mempool::Clock::now();
+	auto deadline = m_mempool && !m_mempool->ready(now) ? m_mempool->deadline() : std::nullopt;
+	if (!deadline || *deadline <= now)
+	{
+		send_proposal(round);
+		return;
+	}
+
+	m_proposal_timer.expires_at(std::min(*deadline, now + m_synchronizer->timeout() / 2));
+	m_proposal_timer.async_wait([weak = weak_from_this(), round](std::error_code error) {
+		auto self = weak.lock();
+		// the replica may have moved on to another round in the meantime
+		if (!error && self && self->m_synchronizer->round() == round)
+		{
+			self->send_proposal(round);
+		}
+	});
+}
+
+void Consensus::send_proposal(Round round)
+{
+	const auto &cert = m_rules->high_qc();
+	// GENESIS_QC does not refer to GENESIS by hash
+	Hash parent = cert.round() > 0 ? cert.block_hash() : GENESIS.hash();
+	auto payload = m_mempool ? m_mempool->take_payload() : std::vector<uint8_t>();
+	auto block = std::make_shared<const Block>(parent, round, m_id, cert, std::move(payload));
+
+	m_network->broadcast_proposal(*block);
+	on_propose(block);
+}
+
+void Consensus::on_propose(BlockPtr block)
+{
+	// GENESIS_QC carries no signatures
+	bool genesis = block->cert().round() == 0 && block->cert().block_hash() == GENESIS_QC.block_hash();
+	if (!genesis && !m_crypto->verify(block->cert(), static_cast<int>(m_quorum_size)))
 	{
 		std::cerr << "on_propose: Invalid quorum cert." << std::endl;
 		return;
 	}
 
-	if (block.proposer() != m_leader_election->get_leader(block.round()))
+	if (block->proposer() != m_leader_election->get_leader(block->round()))
 	{
 		std::cerr << "on_propose: Block was not proposed by expected leader." << std::endl;
 		return;
 	}
 
-	bool safe = false;
+	// A replica that has fallen behind catches up before deciding whether the proposal is safe.
+	if (!m_blockchain->get(block->parent_hash()))
+	{
+		m_fetcher->fetch(block->cert(), m_rules->committed()->round(), [this, block](bool success) {
+			if (success && m_blockchain->get(block->parent_hash()))
+			{
+				on_propose(block);
+			}
+		});
+		return;
+	}
+
+	if (!m_blockchain->add(block))
+	{
+		std::cerr << "on_propose: Block does not follow the round of its parent." << std::endl;
+		return;
+	}
+
+	// The QC in the block advances the phases of the blocks before it, whether or not this replica votes for it.
+	process_cert(block->cert());
 
-	auto block_from_qc = m_blockchain->get(block.cert().block_hash());
-	if (block_from_qc)
+	// A block that arrives after the replica has left its round, e.g. by timing out, comes too late for a vote.
+	if (block->round() != m_synchronizer->round())
 	{
-		if (block_from_qc->round() > m_locked.round())
+		std::cerr << "on_propose: Block is not for the current round." << std::endl;
+		return;
+	}
+
+	// After a timeout, the TimeoutCert of the previous round justifies a block that does not extend the newest QC.
+	if (!m_rules->vote(*block, m_synchronizer->timeout_cert()))
+	{
+		std::cerr << "on_propose: Block was rejected" << std::endl;
+		return;
+	}
+
+	std::cerr << "on_propose: Block was accepted" << std::endl;
+
+	// The vote goes to the leader of the next round, who aggregates the votes into a QuorumCert.
+	auto vote = [this, block]() {
+		Vote vote(m_crypto->sign(block->hash()), block->hash(), block->round());
+		ID leader = m_leader_election->get_leader(block->round() + 1);
+		if (leader == m_id)
 		{
-			safe = true;
+			on_vote(vote);
 		}
+		else
+		{
+			m_network->send_vote(leader, vote);
+		}
+	};
+
+	// The vote must not leave this replica before the voted round is on disk,
+	// or the replica could vote again in the same round after a crash.
+	if (m_safety_log)
+	{
+		persist_blocks();
+		// The log calls back from its own thread, so the vote is sent from the io_context's thread instead.
+		m_safety_log->persist(safety_state(), [&io_context = m_io_context, weak = weak_from_this(), vote]() {
+			asio::post(io_context, [weak, vote]() {
+				if (auto self = weak.lock())
+				{
+					vote();
+				}
+			});
+		});
 	}
 	else
 	{
-		auto ancestor = m_blockchain->get(block.parent_hash());
-		for (; ancestor && ancestor->round() > m_locked.round(); ancestor = m_blockchain->get(ancestor->parent_hash()))
-			;
+		vote();
+	}
+}
 
-		safe = ancestor && ancestor->hash() == m_locked.hash();
+void Consensus::on_commit(std::function<void(BlockPtr)> callback)
+{
+	m_cb_commit = callback;
+}
+
+SafetyState Consensus::safety_state() const
+{
+	return m_rules->state();
+}
+
+Round Consensus::round() const
+{
+	return m_synchronizer->round();
+}
+
+void Consensus::process_cert(const QuorumCert &cert)
+{
+	// Only the block hash is signed, so a QC whose round does not match its block could move the synchronizer to any
+	// round.
+	if (!m_rules->certified_block(cert))
+	{
+		return;
 	}
 
-	if (!safe)
+	// The rules go first, so that a block proposed on entering the next round carries the new high QC.
+	commit(m_rules->update(cert));
+	m_synchronizer->update(cert);
+}
+
+void Consensus::commit(const std::vector<BlockPtr> &blocks)
+{
+	if (blocks.empty())
 	{
-		std::cerr << "on_propose: Block was rejected" << std::endl;
 		return;
 	}
 
-	std::cerr << "on_propose: Block was accepted" << std::endl;
+	for (auto &block : blocks)
+	{
+		if (m_block_log)
+		{
+			m_block_log->append(*block);
+			m_unsynced_blocks = true;
+		}
+		m_leader_election->update(*block);
+		if (m_cb_commit)
+		{
+			m_cb_commit(block);
+		}
+	}
 
-	m_blockchain->add(block);
-	m_synchronizer->update(block.cert());
+	// The executed block moves with each commit, so that a restart does not deliver the blocks again.
+	if (m_safety_log)
+	{
+		persist_blocks();
+		m_safety_log->persist(safety_state());
+	}
 
-	if (block.round() <= m_voted)
+	const auto &committed = m_rules->committed();
+	if (m_block_log && m_checkpoints && m_checkpoints->due(committed->round()))
+	{
+		// The blocks and the safety state that the checkpoint refers to must be on disk before it is.
+		persist_blocks();
+		if (m_safety_log)
+		{
+			m_safety_log->persist_sync(safety_state());
+		}
+
+		Checkpoint checkpoint;
+		checkpoint.committed = committed->hash();
+		checkpoint.committed_round = committed->round();
+		checkpoint.high_qc = m_rules->high_qc();
+		checkpoint.safety = safety_state();
+		checkpoint.log_offset = *m_block_log->position(committed->hash());
+		m_checkpoints->write(checkpoint);
+	}
+
+	// Blocks that conflict with the committed block can never be committed, so they are dropped.
+	m_blockchain->prune(m_rules->committed()->hash());
+}
+
+void Consensus::persist_blocks()
+{
+	if (!m_block_log)
 	{
-		std::cerr << "on_propose: Already voted in this view!" << std::endl;
 		return;
 	}
 
-	// TODO: create vote
+	// Parents go first, so that the blocks above the committed block of a checkpoint all follow it in the log.
+	std::vector<BlockPtr> missing;
+	for (auto block = m_rules->locked(); block && block->hash() != GENESIS.hash() &&
+	                                     !m_block_log->contains(block->hash());
+	     block = m_blockchain->get(block->parent_hash()))
+	{
+		missing.push_back(block);
+	}
+	for (auto block = missing.rbegin(); block != missing.rend(); block++)
+	{
+		m_block_log->append(**block);
+		m_unsynced_blocks = true;
+	}
 
-	auto signature = m_crypto->sign(block.hash());
+	if (m_unsynced_blocks)
+	{
+		m_block_log->sync();
+		m_unsynced_blocks = false;
+	}
 }
 
 void Consensus::on_vote(Vote vote)
 {
+	if (auto cert = m_votes->add(vote))
+	{
+		// The votes may arrive before the proposal they are for.
+		m_fetcher->fetch(*cert, m_rules->committed()->round(), [this, cert = *cert](bool success) {
+			if (success)
+			{
+				process_cert(cert);
+			}
+		});
+	}
+}
+
+void Consensus::on_timeout(Timeout timeout)
+{
+	// Once a quorum has timed out, the synchronizer moves on to the next round.
+	m_synchronizer->add(timeout);
 }
 
 } // namespace HotStuff
@@ -1,39 +1,108 @@
 #pragma once
 
+#include <asio/io_context.hpp>
+#include <asio/steady_timer.hpp>
+
+#include "block_fetcher.h"
 #include "blockchain.h"
+#include "checkpoint.h"
 #include "crypto.h"
+#include "leader_election.h"
+#include "mempool.h"
 #include "network.h"
+#include "safety_log.h"
+#include "safety_rules.h"
 #include "synchronizer.h"
 #include "types.h"
+#include "vote_aggregator.h"
 
 namespace HotStuff
 {
 
-class LeaderElection
+class ConsensusOptions
 {
   public:
-	LeaderElection(int num_replicas);
-	ID get_leader(Round round);
-
-  private:
-	int m_num_replicas;
+	CommitRule commit_rule = CommitRule::THREE_CHAIN;
+	LeaderElectionOptions leader_election;
+	SynchronizerOptions synchronizer;
+	VoteAggregatorOptions votes;
+	BlockFetcherOptions fetcher;
 };
 
-class Consensus
+// Runs chained HotStuff on a replica, driving the components that make up the protocol.
+//
+// The replicas have the IDs 0 to num_replicas - 1, and tolerate (num_replicas - 1) / 3 faulty ones. The consensus is
+// not thread safe. It must only be used from the thread that runs the network's io_context.
+class Consensus : public std::enable_shared_from_this<Consensus>
 {
   public:
-	void on_propose(Block block);
+	// crypto must know the keys of all replicas. With a block log, the chain is restored from it, starting at the
+	// latest checkpoint in checkpoints, if any. If the safety log, or else the checkpoint, holds a state from before a
+	// restart, the replica resumes from it. Throws std::runtime_error if that state refers to blocks that are not in
+	// the chain, since the replica cannot tell which blocks are safe to vote for without them.
+	Consensus(asio::io_context &io_context, ID id, std::shared_ptr<Crypto> crypto, int num_replicas,
+	          std::shared_ptr<Network> network, std::shared_ptr<SafetyLog> safety_log = nullptr,
+	          std::shared_ptr<Mempool> mempool = nullptr, std::shared_ptr<BlockLog> block_log = nullptr,
+	          std::shared_ptr<CheckpointStore> checkpoints = nullptr, ConsensusOptions options = {});
+
+	// Registers with the network, starts the round timer, and proposes the first block if the replica leads round 1.
+	// The network should be connected to the other replicas by then.
+	void start();
+	void stop();
+
+	// Proposes a block for the round, which the replica leads, on top of the highest QC, with a payload from the
+	// mempool. Unless the mempool is empty or ready(), the proposal waits for its deadline(), and is dropped if the
+	// replica has left the round by then.
+	void propose(Round round);
+	void on_propose(BlockPtr block);
 	void on_vote(Vote vote);
+	void on_timeout(Timeout timeout);
+	// The callback receives each committed block once, in chain order, e.g. to execute it.
+	void on_commit(std::function<void(BlockPtr)> callback);
+
+	// Returns the round the replica is in.
+	Round round() const;
+	// Returns the state that is persisted to the safety log.
+	SafetyState safety_state() const;
 
   private:
-	Block m_locked;
-	Block m_executed;
-	Round m_voted;
+	asio::io_context &m_io_context;
+	ID m_id;
+	int m_num_replicas;
+	size_t m_quorum_size;
 
 	std::shared_ptr<BlockChain> m_blockchain;
+	std::shared_ptr<SafetyRules> m_rules;
+	// Fetches blocks that are missing from the chain from other replicas.
+	std::shared_ptr<BlockFetcher> m_fetcher;
 	std::shared_ptr<Crypto> m_crypto;
 	std::shared_ptr<LeaderElection> m_leader_election;
 	std::shared_ptr<Synchronizer> m_synchronizer;
+	std::shared_ptr<Network> m_network;
+	std::shared_ptr<VoteAggregator> m_votes;
+	// If set, proposals carry transactions from it.
+	std::shared_ptr<Mempool> m_mempool;
+	// Delays a proposal until the mempool's deadline.
+	asio::steady_timer m_proposal_timer;
+	// If set, the safety state is persisted before voting.
+	std::shared_ptr<SafetyLog> m_safety_log;
+	// If set, committed blocks are appended to it, so that peers can fetch them after they are pruned from the chain.
+	// So are the blocks that the safety state refers to, so that the chain can be restored from it after a restart.
+	std::shared_ptr<BlockLog> m_block_log;
+	// If set along with the block log, a checkpoint is taken whenever one is due after a commit.
+	std::shared_ptr<CheckpointStore> m_checkpoints;
+	bool m_unsynced_blocks = false;
+
+	std::function<void(BlockPtr)> m_cb_commit;
+
+	// Builds the proposal, and sends it to the other replicas and to itself.
+	void send_proposal(Round round);
+	// Processes a QC that was formed or received, once the block it certifies is in the chain.
+	void process_cert(const QuorumCert &cert);
+	void commit(const std::vector<BlockPtr> &blocks);
+	// Appends the locked block and its ancestors to the block log, if they are missing, and makes the log durable, so
+	// that the safety state can be persisted.
+	void persist_blocks();
 };
 
 } // namespace HotStuff
@@ -0,0 +1,343 @@
+#include <asio/io_context.hpp>
+#include <catch2/catch_test_macros.hpp>
+#include <chrono>
+#include <filesystem>
+#include <set>
+#include <thread>
+
+#include "consensus.h"
+#include "tests/util.h"
+
+using namespace HotStuff;
+using namespace std::chrono_literals;
+
+TEST_CASE("Replicas commit the same blocks", "[consensus]")
+{
+	const int num_replicas = 4;
+	const size_t num_commits = 10;
+	ConsensusOptions options;
+	std::set<ID> crashed;
+	bool persist = false;
+
+	SECTION("Three-chain rule")
+	{
+	}
+	SECTION("Three-chain rule with a crashed replica")
+	{
+		crashed = {2};
+	}
+	SECTION("Three-chain rule with a safety log")
+	{
+		persist = true;
+	}
+	SECTION("Two-chain rule")
+	{
+		options.commit_rule = CommitRule::TWO_CHAIN;
+	}
+	SECTION("Two-chain rule with a crashed replica")
+	{
+		options.commit_rule = CommitRule::TWO_CHAIN;
+		crashed = {2};
+	}
+	// the crashed replica leads rounds 2, 6, 10, ..., which time out
+	options.synchronizer.initial_timeout = 100ms;
+
+	TempDirectory dir;
+	std::filesystem::create_directories(dir.path);
+
+	asio::io_context io_context;
+	auto [peers, keys] = make_peers(num_replicas, 0);
+	std::vector<std::shared_ptr<Consensus>> replicas(num_replicas);
+	std::vector<std::vector<BlockPtr>> committed(num_replicas);
+	std::vector<std::shared_ptr<BlockLog>> block_logs(num_replicas);
+
+	std::vector<std::shared_ptr<Network>> networks;
+	networks = make_networks(io_context, {0, 1, 2, 3}, [&]() {
+		for (ID id : crashed)
+		{
+			networks[id]->close();
+		}
+		for (auto &replica : replicas)
+		{
+			if (replica)
+			{
+				replica->start();
+			}
+		}
+	});
+
+	for (ID id = 0; id < num_replicas; id++)
+	{
+		if (crashed.count(id))
+		{
+			continue;
+		}
+
+		auto crypto = std::make_shared<Crypto>(id, keys[id], peers);
+		std::shared_ptr<SafetyLog> safety_log;
+		if (persist)
+		{
+			SafetyLogOptions log_options;
+			log_options.sync = false;
+			safety_log = std::make_shared<SafetyLog>(dir.path / std::to_string(id), log_options);
+			block_logs[id] = std::make_shared<BlockLog>(dir.path / ("blocks-" + std::to_string(id)));
+		}
+		replicas[id] = std::make_shared<Consensus>(io_context, id, crypto, num_replicas, networks[id], safety_log,
+		                                           nullptr, block_logs[id], nullptr, options);
+		replicas[id]->on_commit([&, id](BlockPtr block) {
+			committed[id].push_back(block);
+			for (ID other = 0; other < num_replicas; other++)
+			{
+				if (replicas[other] && committed[other].size() < num_commits)
+				{
+					return;
+				}
+			}
+			io_context.stop();
+		});
+	}
+
+	auto thread = std::thread([&]() { REQUIRE_NOTHROW(io_context.run_for(20s)); });
+	thread.join();
+	for (auto &replica : replicas)
+	{
+		if (replica)
+		{
+			replica->stop();
+		}
+	}
+
+	ID first = crashed.count(0) ? 1 : 0;
+	for (ID id = 0; id < num_replicas; id++)
+	{
+		if (!replicas[id])
+		{
+			continue;
+		}
+
+		REQUIRE(committed[id].size() >= num_commits);
+		for (size_t i = 0; i < num_commits; i++)
+		{
+			REQUIRE(committed[id][i]->hash() == committed[first][i]->hash());
+			// each committed block is a child of the one before
+			Hash parent = i > 0 ? committed[id][i - 1]->hash() : GENESIS.hash();
+			REQUIRE(committed[id][i]->parent_hash() == parent);
+			REQUIRE((!block_logs[id] || block_logs[id]->contains(committed[id][i]->hash())));
+		}
+	}
+}
+
+TEST_CASE("A QC with a forged round does not move the replica to another round", "[consensus]")
+{
+	const int num_replicas = 4;
+	asio::io_context io_context;
+	auto [peers, keys] = make_peers(num_replicas, 0);
+	auto crypto = std::make_shared<Crypto>(0, keys[0], peers);
+	auto replica = std::make_shared<Consensus>(io_context, 0, crypto, num_replicas,
+	                                           std::make_shared<Network>(io_context));
+	replica->start();
+	REQUIRE(replica->round() == 1);
+
+	auto b1 = std::make_shared<const Block>(GENESIS.hash(), 1, 1, GENESIS_QC);
+	replica->on_propose(b1);
+
+	// votes sign only the block hash, so the signatures are valid for any round
+	auto forged = make_qc(peers, keys, {1, 2, 3}, b1->hash(), Round(1) << 62);
+	replica->on_propose(std::make_shared<const Block>(b1->hash(), 2, 2, forged));
+	REQUIRE(replica->round() == 1);
+
+	auto cert = make_qc(peers, keys, {1, 2, 3}, b1->hash(), 1);
+	replica->on_propose(std::make_shared<const Block>(b1->hash(), 2, 2, cert));
+	REQUIRE(replica->round() == 2);
+	replica->stop();
+}
+
+TEST_CASE("A restarted replica resumes from its safety log", "[consensus]")
+{
+	const int num_replicas = 4;
+	TempDirectory dir;
+	std::filesystem::create_directories(dir.path);
+	auto path = (dir.path / "safety").string();
+	SafetyLogOptions log_options;
+	log_options.sync = false;
+
+	SafetyState state;
+	state.voted = 7;
+	state.locked = GENESIS.hash();
+	state.executed = GENESIS.hash();
+
+	asio::io_context io_context;
+	auto [peers, keys] = make_peers(num_replicas, 0);
+	auto crypto = std::make_shared<Crypto>(0, keys[0], peers);
+	auto restart = [&]() {
+		return std::make_shared<Consensus>(io_context, 0, crypto, num_replicas, std::make_shared<Network>(io_context),
+		                                   std::make_shared<SafetyLog>(path, log_options));
+	};
+
+	SECTION("The replica does not vote again in the rounds it voted in")
+	{
+		SafetyLog(path, log_options).persist_sync(state);
+		auto replica = restart();
+		REQUIRE(replica->safety_state() == state);
+
+		replica->start();
+		replica->on_propose(std::make_shared<const Block>(GENESIS.hash(), 1, 1, GENESIS_QC));
+		REQUIRE(replica->safety_state().voted == 7);
+		replica->stop();
+	}
+	SECTION("The replica refuses to start if the log refers to blocks it does not have")
+	{
+		state.locked_round = 1;
+		state.locked = make_chain(1)[0]->hash();
+		SafetyLog(path, log_options).persist_sync(state);
+		REQUIRE_THROWS_AS(restart(), std::runtime_error);
+	}
+}
+
+TEST_CASE("A replica collects votes after a long run of timeouts", "[consensus]")
+{
+	const int num_replicas = 4;
+	asio::io_context io_context;
+	auto [peers, keys] = make_peers(num_replicas, 0);
+	std::vector<std::shared_ptr<Crypto>> signers;
+	for (ID id = 0; id < num_replicas; id++)
+	{
+		signers.push_back(std::make_shared<Crypto>(id, keys[id], peers));
+	}
+	auto replica =
+	    std::make_shared<Consensus>(io_context, 0, signers[0], num_replicas, std::make_shared<Network>(io_context));
+	replica->start();
+
+	// far more rounds time out than the vote aggregator looks ahead
+	const Round round = 103;
+	for (Round timed_out = 1; timed_out < round; timed_out++)
+	{
+		for (ID id = 1; id < num_replicas; id++)
+		{
+			replica->on_timeout(Timeout(signers[id]->sign(timeout_hash(timed_out, 0)), timed_out, 0));
+		}
+	}
+	REQUIRE(replica->round() == round);
+
+	// the replica leads the next round, so it collects the votes for the block, including its own
+	auto block = std::make_shared<const Block>(GENESIS.hash(), round, 3, GENESIS_QC);
+	replica->on_propose(block);
+	for (ID id = 1; id < 3; id++)
+	{
+		replica->on_vote(Vote(signers[id]->sign(block->hash()), block->hash(), round));
+	}
+	REQUIRE(replica->round() == round + 1);
+	replica->stop();
+}
+
+TEST_CASE("Replicas restart from their logs and checkpoints", "[consensus]")
+{
+	const int num_replicas = 4;
+	ConsensusOptions options;
+	options.synchronizer.initial_timeout = 100ms;
+	SafetyLogOptions log_options;
+	log_options.sync = false;
+	CheckpointOptions checkpoint_options;
+	checkpoint_options.interval = 3;
+
+	TempDirectory dir;
+	auto [peers, keys] = make_peers(num_replicas, 0);
+	std::vector<std::vector<BlockPtr>> committed(num_replicas);
+
+	// Runs the replicas from what they stored in dir, until each has committed num_commits blocks in all.
+	auto run = [&](size_t num_commits) {
+		asio::io_context io_context;
+		std::vector<std::shared_ptr<Consensus>> replicas(num_replicas);
+		std::vector<std::shared_ptr<Network>> networks;
+		networks = make_networks(io_context, {0, 1, 2, 3}, [&]() {
+			for (auto &replica : replicas)
+			{
+				replica->start();
+			}
+		});
+
+		for (ID id = 0; id < num_replicas; id++)
+		{
+			auto path = dir.path / std::to_string(id);
+			std::filesystem::create_directories(path);
+			replicas[id] = std::make_shared<Consensus>(
+			    io_context, id, std::make_shared<Crypto>(id, keys[id], peers), num_replicas, networks[id],
+			    std::make_shared<SafetyLog>(path / "safety", log_options), nullptr,
+			    std::make_shared<BlockLog>(path / "blocks"),
+			    std::make_shared<CheckpointStore>(path / "checkpoints", checkpoint_options), options);
+			replicas[id]->on_commit([&, id](BlockPtr block) {
+				committed[id].push_back(block);
+				for (auto &blocks : committed)
+				{
+					if (blocks.size() < num_commits)
+					{
+						return;
+					}
+				}
+				io_context.stop();
+			});
+		}
+
+		auto thread = std::thread([&]() { REQUIRE_NOTHROW(io_context.run_for(20s)); });
+		thread.join();
+		for (auto &replica : replicas)
+		{
+			replica->stop();
+		}
+	};
+
+	run(5);
+	run(10);
+
+	// each replica carries on from the last block it committed, without committing any block twice
+	for (ID id = 0; id < num_replicas; id++)
+	{
+		REQUIRE(committed[id].size() >= 10);
+		for (size_t i = 0; i < committed[id].size(); i++)
+		{
+			REQUIRE((i >= 10 || committed[id][i]->hash() == committed[0][i]->hash()));
+			Hash parent = i > 0 ? committed[id][i - 1]->hash() : GENESIS.hash();
+			REQUIRE(committed[id][i]->parent_hash() == parent);
+		}
+
+		auto checkpoint = CheckpointStore(dir.path / std::to_string(id) / "checkpoints").load_latest();
+		REQUIRE(checkpoint);
+		REQUIRE(checkpoint->committed_round > 0);
+	}
+}
+
+TEST_CASE("The leader waits for the mempool's deadline before proposing", "[consensus]")
+{
+	const int num_replicas = 4;
+	ConsensusOptions options;
+	options.synchronizer.initial_timeout = 10s;
+	MempoolOptions mempool_options;
+	mempool_options.max_delay = 200ms;
+
+	asio::io_context io_context;
+	auto [peers, keys] = make_peers(num_replicas, 0);
+	auto mempool = std::make_shared<Mempool>(mempool_options);
+	// the replica leads round 1, and votes for its own proposal
+	auto replica = std::make_shared<Consensus>(io_context, 1, std::make_shared<Crypto>(1, keys[1], peers),
+	                                           num_replicas, std::make_shared<Network>(io_context), nullptr, mempool,
+	                                           nullptr, nullptr, options);
+
+	SECTION("Without transactions")
+	{
+		replica->start();
+		REQUIRE(replica->safety_state().voted == 1);
+	}
+	SECTION("With a transaction that has not waited long enough")
+	{
+		REQUIRE(mempool->submit(Transaction{1, 2, 3}));
+		replica->start();
+		io_context.run_for(50ms);
+		REQUIRE(replica->safety_state().voted == 0);
+		REQUIRE(mempool->num_pending() == 1);
+
+		io_context.run_for(300ms);
+		REQUIRE(replica->safety_state().voted == 1);
+		REQUIRE(mempool->num_pending() == 0);
+	}
+	replica->stop();
+}
@@ -1,5 +1,13 @@
+#include <algorithm>
+#include <asio/post.hpp>
+#include <atomic>
 #include <botan/sha2_32.h>
+#include <botan/system_rng.h>
+#include <condition_variable>
 #include <fmt/core.h>
+#include <mutex>
+#include <stdexcept>
+#include <unordered_set>
 
 #include "crypto.h"
 
@@ -15,7 +23,7 @@ Signature::Signature()
 {
 }
 
-Signature::Signature(ID signer, std::vector<uint8_t> signature) : m_signer(signer), m_signature(signature)
+Signature::Signature(ID signer, std::vector<uint8_t> signature) : m_signature(signature), m_signer(signer)
 {
 }
 
@@ -23,14 +31,25 @@ QuorumCert::QuorumCert()
 {
 }
 
-QuorumCert::QuorumCert(const QuorumCert &other)
-    : m_block(other.m_block), m_round(other.m_round), m_signatures(other.m_signatures)
+QuorumCert::QuorumCert(Hash block, Round round, std::vector<Signature> signatures) : m_block(block), m_round(round)
 {
-}
+	std::stable_sort(signatures.begin(), signatures.end(),
+	                 [](const Signature &a, const Signature &b) { return a.signer() < b.signer(); });
 
-QuorumCert::QuorumCert(Hash block, Round round, std::vector<Signature> signatures)
-    : m_block(block), m_round(round), m_signatures(signatures)
-{
+	for (auto &signature : signatures)
+	{
+		if (m_signers.test(signature.signer()))
+		{
+			continue;
+		}
+		if (!m_signatures.empty() && signature.m_signature.size() != signature_size())
+		{
+			throw std::invalid_argument("signatures of a QuorumCert must all have the same size");
+		}
+
+		m_signers.set(signature.signer());
+		m_signatures.insert(m_signatures.end(), signature.m_signature.begin(), signature.m_signature.end());
+	}
 }
 
 Hash QuorumCert::block_hash() const
@@ -46,32 +65,57 @@ Round QuorumCert::round() const
 std::vector<ID> QuorumCert::signers() const
 {
 	std::vector<ID> signers;
+	signers.reserve(num_signers());
 
-	for (auto &signature : m_signatures)
-	{
-		signers.push_back(signature.signer());
-	}
+	m_signers.for_each([&](ID id) { signers.push_back(id); });
 
 	return signers;
 }
 
-TimeoutCert::TimeoutCert()
+const Bitset &QuorumCert::signer_set() const
+{
+	return m_signers;
+}
+
+bool QuorumCert::has_signer(ID id) const
 {
+	return m_signers.test(id);
 }
 
-TimeoutCert::TimeoutCert(Round round, std::vector<Signature> signatures) : m_round(round), m_signatures(signatures)
+size_t QuorumCert::num_signers() const
 {
+	return m_signers.count();
 }
 
-TimeoutCert::TimeoutCert(const TimeoutCert &other) : m_round(other.m_round), m_signatures(other.m_signatures)
+size_t QuorumCert::signature_size() const
+{
+	size_t n = num_signers();
+	return n > 0 ? m_signatures.size() / n : 0;
+}
+
+TimeoutCert::TimeoutCert()
 {
 }
 
+TimeoutCert::TimeoutCert(Round round, std::vector<Signature> signatures, std::vector<Round> high_qc_rounds)
+    : m_signatures(std::move(signatures)), m_high_qc_rounds(std::move(high_qc_rounds)), m_round(round)
+{
+	if (m_signatures.size() != m_high_qc_rounds.size())
+	{
+		throw std::invalid_argument("a TimeoutCert needs the high QC round of each signer");
+	}
+}
+
 Round TimeoutCert::round() const
 {
 	return m_round;
 }
 
+Round TimeoutCert::max_high_qc_round() const
+{
+	return m_high_qc_rounds.empty() ? 0 : *std::max_element(m_high_qc_rounds.begin(), m_high_qc_rounds.end());
+}
+
 std::vector<ID> TimeoutCert::signers()
 {
 	std::vector<ID> signers;
@@ -84,53 +128,310 @@ std::vector<ID> TimeoutCert::signers()
 	return signers;
 }
 
+bool Crypto::knows(ID signer) const
+{
+	return m_peers->find(signer) != nullptr;
+}
+
 Signature Crypto::sign(Hash msg_hash)
 {
-	auto signer = Botan::PK_Signer(this->m_key, Botan::system_rng(), "Raw");
-	auto signature_bytes = signer.sign_message(msg_hash.begin(), msg_hash.size(), Botan::system_rng());
+	std::lock_guard lock(m_signer_mutex);
+	auto signature_bytes = m_signer.sign_message(msg_hash.begin(), msg_hash.size(), Botan::system_rng());
 	return Signature(this->m_id, std::move(signature_bytes));
 }
 
+Hash timeout_hash(Round round, Round high_qc_round)
+{
+	// The prefix keeps timeouts apart from block hashes, which are signed by votes.
+	const char prefix[] = "timeout";
+	Hash hash;
+	Botan::SHA_256 hasher;
+
+	hasher.update(reinterpret_cast<const uint8_t *>(prefix), sizeof(prefix));
+	hasher.update(reinterpret_cast<const uint8_t *>(&round), sizeof(round));
+	hasher.update(reinterpret_cast<const uint8_t *>(&high_qc_round), sizeof(high_qc_round));
+	hasher.final(hash.data());
+
+	return hash;
+}
+
+static Hash signature_cache_key(ID signer, Hash msg_hash, const uint8_t *signature, size_t signature_size)
+{
+	Hash key;
+	Botan::SHA_256 hasher;
+
+	hasher.update(reinterpret_cast<const uint8_t *>(&signer), sizeof(signer));
+	hasher.update(msg_hash.data(), msg_hash.size());
+	hasher.update(signature, signature_size);
+	hasher.final(key.data());
+
+	return key;
+}
+
+// The key covers the signatures themselves, so that a certificate with the same signers as a verified one, but with
+// other signatures, is not taken for verified.
+static Hash qc_cache_key(Hash block_hash, Round round, const Bitset &signers, const std::vector<uint8_t> &signatures)
+{
+	Hash key;
+	Botan::SHA_256 hasher;
+
+	hasher.update(block_hash.data(), block_hash.size());
+	hasher.update(reinterpret_cast<const uint8_t *>(&round), sizeof(round));
+	const auto &words = signers.words();
+	uint64_t num_words = words.size();
+	hasher.update(reinterpret_cast<const uint8_t *>(&num_words), sizeof(num_words));
+	hasher.update(reinterpret_cast<const uint8_t *>(words.data()), words.size() * sizeof(uint64_t));
+	hasher.update(signatures.data(), signatures.size());
+	hasher.final(key.data());
+
+	return key;
+}
+
 Crypto::VerifyResult Crypto::verify(const QuorumCert &qc, int quorum_size)
 {
+	auto key = qc_cache_key(qc.block_hash(), qc.round(), qc.signer_set(), qc.m_signatures);
+	if (auto verified_quorum_size = m_qc_cache.find(key); verified_quorum_size && *verified_quorum_size >= quorum_size)
+	{
+		return VerifyResult(VerifyResult::OK);
+	}
+
+	auto result = verify_uncached(qc, quorum_size);
+	if (result)
+	{
+		m_qc_cache.insert(key, quorum_size);
+	}
+
+	return result;
+}
+
+Crypto::VerifyResult Crypto::verify(const TimeoutCert &tc, int quorum_size)
+{
+	std::unordered_set<ID> signers;
+	std::vector<std::pair<Signature, Hash>> batch;
+	for (size_t i = 0; i < tc.m_signatures.size(); i++)
+	{
+		const auto &signature = tc.m_signatures[i];
+		if (signers.insert(signature.signer()).second)
+		{
+			batch.emplace_back(signature, timeout_hash(tc.m_round, tc.m_high_qc_rounds[i]));
+		}
+	}
+
 	int num_ok = 0;
-	for (auto sig : qc.m_signatures)
+	std::vector<std::pair<ID, VerifyResult::Kind>> failures;
+	auto results = verify_batch(batch);
+	for (size_t i = 0; i < batch.size(); i++)
 	{
-		if (!verify(sig, qc.block_hash()))
+		if (results[i].ok())
+		{
+			num_ok++;
+		}
+		else
 		{
+			failures.emplace_back(batch[i].first.signer(), results[i].kind());
+		}
+	}
+
+	if (num_ok >= quorum_size)
+	{
+		return VerifyResult(VerifyResult::OK, "", std::move(failures));
+	}
+
+	return VerifyResult(VerifyResult::NOT_A_QUORUM,
+	                    fmt::format("got only {} of {} required timeouts", num_ok, quorum_size), std::move(failures));
+}
+
+Crypto::VerifyResult Crypto::verify_uncached(const QuorumCert &qc, int quorum_size)
+{
+	auto signers = qc.signers();
+	if (m_verify_pool && signers.size() > 1)
+	{
+		return verify_parallel(qc, quorum_size);
+	}
+
+	int num_ok = 0;
+	int max_failures = static_cast<int>(signers.size()) - quorum_size;
+	size_t signature_size = qc.signature_size();
+	std::vector<std::pair<ID, VerifyResult::Kind>> failures;
+
+	for (size_t i = 0; i < signers.size(); i++)
+	{
+		const uint8_t *signature = qc.m_signatures.data() + i * signature_size;
+		if (auto result = verify_signature(signers[i], signature, signature_size, qc.block_hash()); !result)
+		{
+			failures.emplace_back(signers[i], result.kind());
+			if (static_cast<int>(failures.size()) > max_failures)
+			{
+				break;
+			}
 			continue;
 		}
 
 		num_ok++;
 		if (num_ok >= quorum_size)
 		{
-			return VerifyResult(VerifyResult::OK);
+			return VerifyResult(VerifyResult::OK, "", std::move(failures));
+		}
+	}
+
+	return VerifyResult(VerifyResult::NOT_A_QUORUM,
+	                    fmt::format("got only {} of {} required signatures", num_ok, quorum_size), std::move(failures));
+}
+
+Crypto::VerifyResult Crypto::verify_parallel(const QuorumCert &qc, int quorum_size)
+{
+	const auto signers = qc.signers();
+	const size_t signature_size = qc.signature_size();
+	const int max_failures = static_cast<int>(signers.size()) - quorum_size;
+
+	std::atomic<int> num_ok = 0;
+	std::atomic<int> num_failed = 0;
+
+	std::mutex mutex;
+	std::vector<std::pair<ID, VerifyResult::Kind>> failures;
+
+	// Stop as soon as the outcome is decided.
+	run_parallel(signers.size(), [&](size_t i) {
+		const uint8_t *signature = qc.m_signatures.data() + i * signature_size;
+		if (auto result = verify_signature(signers[i], signature, signature_size, qc.block_hash()); result)
+		{
+			num_ok++;
+		}
+		else
+		{
+			num_failed++;
+			std::lock_guard lock(mutex);
+			failures.emplace_back(signers[i], result.kind());
 		}
+		return num_ok < quorum_size && num_failed <= max_failures;
+	});
+
+	if (num_ok >= quorum_size)
+	{
+		return VerifyResult(VerifyResult::OK, "", std::move(failures));
 	}
 
 	return VerifyResult(VerifyResult::NOT_A_QUORUM,
-	                    fmt::format("got only {} of {} required signatures", num_ok, quorum_size));
+	                    fmt::format("got only {} of {} required signatures", num_ok.load(), quorum_size),
+	                    std::move(failures));
+}
+
+std::vector<Crypto::VerifyResult> Crypto::verify_batch(const std::vector<std::pair<Signature, Hash>> &batch)
+{
+	std::vector<VerifyResult> results(batch.size(), VerifyResult(VerifyResult::OK));
+
+	if (!m_verify_pool)
+	{
+		for (size_t i = 0; i < batch.size(); i++)
+		{
+			results[i] = verify(batch[i].first, batch[i].second);
+		}
+		return results;
+	}
+
+	run_parallel(batch.size(), [&](size_t i) {
+		results[i] = verify(batch[i].first, batch[i].second);
+		return true;
+	});
+
+	return results;
+}
+
+void Crypto::run_parallel(size_t n, const std::function<bool(size_t)> &task)
+{
+	std::atomic<size_t> next = 0;
+	std::atomic<bool> stop = false;
+
+	// Each worker claims one index at a time.
+	auto work = [&]() {
+		while (!stop)
+		{
+			size_t i = next.fetch_add(1);
+			if (i >= n)
+			{
+				return;
+			}
+			if (!task(i))
+			{
+				stop = true;
+			}
+		}
+	};
+
+	// The workers reference the state on this stack frame,
+	// so we must wait for all of them to finish, even if they are told to stop early.
+	std::mutex mutex;
+	std::condition_variable done;
+	size_t num_workers = n > 0 ? std::min(m_num_verify_threads, n - 1) : 0;
+	size_t num_running = num_workers;
+
+	for (size_t i = 0; i < num_workers; i++)
+	{
+		asio::post(*m_verify_pool, [&]() {
+			work();
+			std::lock_guard lock(mutex);
+			if (--num_running == 0)
+			{
+				done.notify_one();
+			}
+		});
+	}
+
+	work();
+
+	std::unique_lock lock(mutex);
+	done.wait(lock, [&]() { return num_running == 0; });
 }
 
 Crypto::VerifyResult Crypto::verify(const Signature &sig, Hash msg_hash)
 {
-	auto peer = m_peers->find(sig.signer());
+	return verify_signature(sig.signer(), sig.m_signature.data(), sig.m_signature.size(), msg_hash);
+}
+
+Crypto::VerifyResult Crypto::verify_signature(ID signer, const uint8_t *signature, size_t signature_size, Hash msg_hash)
+{
+	auto peer = m_peers->find(signer);
 	if (!peer)
 	{
-		return VerifyResult(VerifyResult::PEER_NOT_FOUND, fmt::format("Peer with id '{}' not found.", sig.signer()));
+		return VerifyResult(VerifyResult::PEER_NOT_FOUND, fmt::format("Peer with id '{}' not found.", signer));
+	}
+
+	auto key = signature_cache_key(signer, msg_hash, signature, signature_size);
+	if (m_signature_cache.find(key))
+	{
+		return VerifyResult(VerifyResult::OK);
 	}
 
-	auto verifier = Botan::PK_Verifier(peer->public_key(), "Raw");
-	if (verifier.verify_message(&msg_hash.front(), msg_hash.size(), &sig.m_signature.front(), sig.m_signature.size()))
+	if (peer->verify(msg_hash.data(), msg_hash.size(), signature, signature_size))
 	{
+		m_signature_cache.insert(key, true);
 		return VerifyResult(VerifyResult::OK);
 	}
 
 	return VerifyResult(VerifyResult::INVALID_SIGNATURE);
 }
 
-Crypto::Crypto(ID id, Botan::ECDSA_PrivateKey key, std::shared_ptr<Peers> peers) : m_id(id), m_key(key), m_peers(peers)
+Crypto::Crypto(ID id, std::shared_ptr<const Botan::Private_Key> key, std::shared_ptr<Peers> peers,
+               VerifyOptions options)
+    : m_id(id), m_key(key), m_scheme(signature_scheme_of(*key)),
+      m_signer(*m_key, Botan::system_rng(), signature_padding(m_scheme)), m_peers(peers),
+      m_num_verify_threads(options.num_threads), m_signature_cache(options.signature_cache_size),
+      m_qc_cache(options.qc_cache_size)
+{
+	if (options.num_threads > 0)
+	{
+		m_verify_pool = std::make_unique<asio::thread_pool>(options.num_threads);
+	}
+}
+
+SignatureScheme Crypto::scheme() const
+{
+	return m_scheme;
+}
+
+Crypto::CacheStats Crypto::cache_stats() const
 {
+	return {m_signature_cache.hits(), m_signature_cache.misses(), m_qc_cache.hits(), m_qc_cache.misses()};
 }
 
 Crypto::VerifyResult::Kind Crypto::VerifyResult::kind()
@@ -148,13 +449,19 @@ std::string Crypto::VerifyResult::message()
 	return m_message;
 }
 
+const std::vector<std::pair<ID, Crypto::VerifyResult::Kind>> &Crypto::VerifyResult::failures()
+{
+	return m_failures;
+}
+
 Crypto::VerifyResult::operator bool()
 {
 	return ok();
 }
 
-Crypto::VerifyResult::VerifyResult(Crypto::VerifyResult::Kind kind, std::string message)
-    : m_kind(kind), m_message(message)
+Crypto::VerifyResult::VerifyResult(Crypto::VerifyResult::Kind kind, std::string message,
+                                   std::vector<std::pair<ID, Kind>> failures)
+    : m_kind(kind), m_message(message), m_failures(std::move(failures))
 {
 }
 
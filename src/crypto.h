@@ -1,14 +1,20 @@
 #pragma once
 
-#include <botan/ecdsa.h>
+#include <asio/thread_pool.hpp>
+#include <botan/pk_keys.h>
 #include <botan/pubkey.h>
 #include <cereal/access.hpp>
 #include <cereal/types/array.hpp>
 #include <cereal/types/vector.hpp>
+#include <functional>
+#include <mutex>
 
 #include "util/array_hasher.h" // specialization needed to allow Hash to be usable in unordered_map
+#include "util/bitset.h"
+#include "util/concurrent_cache.h"
 
 #include "peers.h"
+#include "signature_scheme.h"
 #include "types.h"
 
 namespace HotStuff
@@ -29,6 +35,7 @@ class Signature
 
   private:
 	friend class Crypto;
+	friend class QuorumCert;
 	friend class cereal::access;
 
 	std::vector<uint8_t> m_signature;
@@ -42,71 +49,136 @@ class Signature
 	}
 };
 
+// A set of signatures on a block.
+// Signatures are stored as a bitmap of signers and a single buffer holding the signatures back to back,
+// in ascending order of signer. All signatures of a certificate must have the same size.
 class QuorumCert
 {
   public:
 	// Returns an empty QuorumCert.
 	// You probably shouldn't use this unless you need it for deserialization.
 	QuorumCert();
-	QuorumCert(const QuorumCert &other);
+	// If several signatures have the same signer, only the first one is kept.
+	// Throws std::invalid_argument if the signatures are not all of the same size.
 	QuorumCert(Hash block, Round round, std::vector<Signature> signatures);
 
 	Hash block_hash() const;
 	Round round() const;
+	// Returns the signers in ascending order.
 	std::vector<ID> signers() const;
+	const Bitset &signer_set() const;
+	bool has_signer(ID id) const;
+	size_t num_signers() const;
 
   private:
 	friend class Crypto;
 	friend class cereal::access;
 
-	std::vector<Signature> m_signatures;
+	Bitset m_signers;
+	std::vector<uint8_t> m_signatures;
 	Hash m_block;
 	Round m_round;
 
-	template <class Archive> void serialize(Archive &archive)
+	size_t signature_size() const;
+
+	template <class Archive> void save(Archive &archive) const
+	{
+		archive(m_signers, m_signatures, m_block, m_round);
+	}
+
+	template <class Archive> void load(Archive &archive)
 	{
-		archive(m_signatures, m_block, m_round);
+		archive(m_signers, m_signatures, m_block, m_round);
+
+		size_t num_signers = m_signers.count();
+		if (num_signers == 0 ? !m_signatures.empty() : m_signatures.size() % num_signers != 0)
+		{
+			throw cereal::Exception("QuorumCert signatures do not match its signers");
+		}
 	}
 };
 
+// A set of timeouts for a round. Each replica signs the round along with the round of its highest QC
+// (see timeout_hash), so the certificate shows how far the quorum that timed out had gotten.
 class TimeoutCert
 {
   public:
 	// Returns an empty TimeoutCert.
 	// You probably shouldn't use this unless you need it for deserialization.
 	TimeoutCert();
-	TimeoutCert(Round round, std::vector<Signature> signatures);
-	TimeoutCert(const TimeoutCert &other);
+	// high_qc_rounds[i] is the round of the highest QC of the signer of signatures[i].
+	// Throws std::invalid_argument if the two do not have the same size.
+	TimeoutCert(Round round, std::vector<Signature> signatures, std::vector<Round> high_qc_rounds);
 
 	Round round() const;
+	// Returns the highest QC round that any of the signers had.
+	Round max_high_qc_round() const;
 
   private:
 	friend class Crypto;
 	friend class cereal::access;
 
 	std::vector<Signature> m_signatures;
+	std::vector<Round> m_high_qc_rounds;
 	Round m_round;
 
 	std::vector<ID> signers();
 
 	template <class Archive> void serialize(Archive &archive)
 	{
-		archive(m_signatures, m_round);
+		archive(m_signatures, m_high_qc_rounds, m_round);
 	}
 };
 
+// Returns the message that a replica signs when it times out in a round.
+Hash timeout_hash(Round round, Round high_qc_round);
+
 const QuorumCert GENESIS_QC = QuorumCert(Hash(), Round(), std::vector<Signature>());
 
+class VerifyOptions
+{
+  public:
+	// If greater than zero, batches of signatures are verified in parallel
+	// by a pool of this many threads (plus the calling thread).
+	size_t num_threads = 0;
+	// Max number of verified signatures and quorum certificates to remember. Zero disables caching.
+	size_t signature_cache_size = 64 * 1024;
+	size_t qc_cache_size = 1024;
+};
+
 class Crypto
 {
   public:
 	class VerifyResult;
 
-	Crypto(ID id, Botan::ECDSA_PrivateKey key, std::shared_ptr<Peers> m_peers);
+	// The signature scheme is determined by the type of the key (see signature_scheme.h).
+	Crypto(ID id, std::shared_ptr<const Botan::Private_Key> key, std::shared_ptr<Peers> m_peers,
+	       VerifyOptions options = {});
+
+	SignatureScheme scheme() const;
+	// Returns true if the signer is a known peer, whose signatures can be verified.
+	bool knows(ID signer) const;
 
 	Signature sign(Hash msg_hash);
+	// Verifies signatures until quorum_size valid signatures are found, or until that becomes impossible.
+	// Certificates and signatures that were verified before are accepted without checking them again.
 	VerifyResult verify(const QuorumCert &qc, int quorum_size);
+	// Verifies that a quorum of distinct replicas signed the timeout, each along with its high QC round.
+	VerifyResult verify(const TimeoutCert &tc, int quorum_size);
 	VerifyResult verify(const Signature &sig, Hash msg_hash);
+	// Verifies a batch of signatures, e.g. a burst of votes, and returns a result for each of them.
+	std::vector<VerifyResult> verify_batch(const std::vector<std::pair<Signature, Hash>> &batch);
+
+	class CacheStats
+	{
+	  public:
+		uint64_t signature_hits;
+		uint64_t signature_misses;
+		uint64_t qc_hits;
+		uint64_t qc_misses;
+	};
+
+	CacheStats cache_stats() const;
 
 	class VerifyResult
 	{
@@ -122,21 +194,47 @@ class Crypto
 		Kind kind();
 		bool ok();
 		std::string message();
+		// Returns the signers whose signatures failed to verify, along with the reason.
+		// When verifying a quorum certificate, signatures that were not checked because the outcome
+		// was already decided are not included.
+		const std::vector<std::pair<ID, Kind>> &failures();
 
 		operator bool();
 
 	  private:
 		friend class Crypto;
 
-		VerifyResult(Kind kind, std::string message = "");
+		VerifyResult(Kind kind, std::string message = "", std::vector<std::pair<ID, Kind>> failures = {});
 		Kind m_kind;
 		std::string m_message;
+		std::vector<std::pair<ID, Kind>> m_failures;
 	};
 
   private:
 	ID m_id;
-	Botan::ECDSA_PrivateKey m_key;
+	std::shared_ptr<const Botan::Private_Key> m_key;
+	SignatureScheme m_scheme;
+	// PK_Signer is not thread safe.
+	std::mutex m_signer_mutex;
+	Botan::PK_Signer m_signer;
 	std::shared_ptr<Peers> m_peers;
+	std::unique_ptr<asio::thread_pool> m_verify_pool;
+	size_t m_num_verify_threads;
+
+	// Keys of signatures that were verified successfully.
+	// The key is a digest of the signer, the message hash, and the signature.
+	ConcurrentCache<Hash, bool> m_signature_cache;
+	// Quorum certificates that were verified successfully, and the quorum size they were verified against.
+	// The key is a digest of the block hash, the round, and the set of signers.
+	ConcurrentCache<Hash, int> m_qc_cache;
+
+	VerifyResult verify_signature(ID signer, const uint8_t *signature, size_t signature_size, Hash msg_hash);
+	VerifyResult verify_uncached(const QuorumCert &qc, int quorum_size);
+	VerifyResult verify_parallel(const QuorumCert &qc, int quorum_size);
+
+	// Calls task(i) for i in [0, n) on the verify pool and the calling thread, and waits for all calls to finish.
+	// Once a task returns false, no more tasks are started.
+	void run_parallel(size_t n, const std::function<bool(size_t)> &task);
 };
 
 } // namespace HotStuff
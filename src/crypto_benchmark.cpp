@@ -0,0 +1,80 @@
+#include <catch2/benchmark/catch_benchmark.hpp>
+#include <catch2/catch_test_macros.hpp>
+#include <fmt/core.h>
+#include <thread>
+
+#include "blockchain.h"
+#include "crypto.h"
+#include "tests/util.h"
+
+using namespace HotStuff;
+
+static const char *scheme_name(SignatureScheme scheme)
+{
+	return scheme == SignatureScheme::ED25519 ? "ed25519" : "ecdsa-secp256k1";
+}
+
+// Caching would turn every iteration after the first into a cache hit.
+static VerifyOptions uncached(size_t num_threads = 0)
+{
+	VerifyOptions options;
+	options.num_threads = num_threads;
+	options.signature_cache_size = 0;
+	options.qc_cache_size = 0;
+	return options;
+}
+
+TEST_CASE("Sign and verify", "[crypto][benchmark]")
+{
+	for (auto scheme : {SignatureScheme::ECDSA_SECP256K1, SignatureScheme::ED25519})
+	{
+		auto [peers, keys] = make_peers(1, 1, scheme);
+		Crypto crypto(1, keys.at(1), peers, uncached());
+		auto signature = crypto.sign(GENESIS.hash());
+
+		BENCHMARK(fmt::format("sign {}", scheme_name(scheme)))
+		{
+			return crypto.sign(GENESIS.hash());
+		};
+
+		BENCHMARK(fmt::format("verify {}", scheme_name(scheme)))
+		{
+			return crypto.verify(signature, GENESIS.hash()).ok();
+		};
+	}
+}
+
+TEST_CASE("Verify QuorumCert", "[crypto][benchmark]")
+{
+	size_t num_threads = std::max(2u, std::thread::hardware_concurrency()) - 1;
+
+	for (auto scheme : {SignatureScheme::ECDSA_SECP256K1, SignatureScheme::ED25519})
+	{
+		for (int n : {4, 16, 64, 128})
+		{
+			// n = 3f + 1, quorum = 2f + 1
+			int quorum_size = n - (n - 1) / 3;
+
+			auto [peers, keys] = make_peers(n, 1, scheme);
+			std::vector<ID> signers;
+			for (ID id = 1; id <= static_cast<ID>(quorum_size); id++)
+			{
+				signers.push_back(id);
+			}
+			auto qc = make_qc(peers, keys, signers);
+
+			Crypto sequential(1, keys.at(1), peers, uncached());
+			Crypto parallel(1, keys.at(1), peers, uncached(num_threads));
+
+			BENCHMARK(fmt::format("sequential {} n={}", scheme_name(scheme), n))
+			{
+				return sequential.verify(qc, quorum_size).ok();
+			};
+
+			BENCHMARK(fmt::format("parallel {} n={} threads={}", scheme_name(scheme), n, num_threads + 1))
+			{
+				return parallel.verify(qc, quorum_size).ok();
+			};
+		}
+	}
+}
@@ -1,11 +1,15 @@
+#include <algorithm>
 #include <botan/ecdsa.h>
+#include <botan/system_rng.h>
 #include <catch2/catch_test_macros.hpp>
 #include <cereal/archives/binary.hpp>
 #include <sstream>
+#include <stdexcept>
 
 #include "blockchain.h"
 #include "crypto.h"
 #include "tests/util.h"
+#include "util/buffer_archive.h"
 
 using namespace HotStuff;
 
@@ -21,6 +25,55 @@ TEST_CASE("Create and verify Signature", "[crypto]")
 	REQUIRE(crypto.verify(signature, GENESIS.hash()).ok());
 }
 
+TEST_CASE("Create and verify Ed25519 Signature", "[crypto]")
+{
+	auto [peers, keys] = make_peers(4, 1, SignatureScheme::ED25519);
+	Crypto crypto(1, keys.at(1), peers);
+
+	REQUIRE(crypto.scheme() == SignatureScheme::ED25519);
+
+	auto signature = crypto.sign(GENESIS.hash());
+
+	REQUIRE(crypto.verify(signature, GENESIS.hash()).ok());
+	REQUIRE(crypto.verify(make_qc(peers, keys), 3).ok());
+}
+
+TEST_CASE("Tell the signature scheme from the key", "[crypto]")
+{
+	REQUIRE(signature_scheme_of(*gen_key(SignatureScheme::ECDSA_SECP256K1)) == SignatureScheme::ECDSA_SECP256K1);
+	REQUIRE(signature_scheme_of(*gen_key(SignatureScheme::ED25519)) == SignatureScheme::ED25519);
+
+	// ECDSA keys on other curves are not supported
+	Botan::ECDSA_PrivateKey key(Botan::system_rng(), Botan::EC_Group("secp256r1"));
+	REQUIRE_THROWS_AS(signature_scheme_of(key), std::invalid_argument);
+}
+
+TEST_CASE("Verify batch of signatures", "[crypto]")
+{
+	auto [peers, keys] = make_peers(4, 1, SignatureScheme::ED25519);
+	VerifyOptions options;
+	options.num_threads = 2;
+	Crypto crypto(1, keys.at(1), peers, options);
+
+	Hash other_hash = GENESIS.hash();
+	other_hash[0]++;
+
+	std::vector<std::pair<Signature, Hash>> batch;
+	for (ID id = 1; id <= 4; id++)
+	{
+		Crypto signer(id, keys.at(id), peers);
+		batch.emplace_back(signer.sign(GENESIS.hash()), id == 3 ? other_hash : GENESIS.hash());
+	}
+
+	auto results = crypto.verify_batch(batch);
+
+	REQUIRE(results.size() == 4);
+	REQUIRE(results[0].ok());
+	REQUIRE(results[1].ok());
+	REQUIRE(results[2].kind() == Crypto::VerifyResult::INVALID_SIGNATURE);
+	REQUIRE(results[3].ok());
+}
+
 TEST_CASE("Check that valid QuorumCert is verified", "[crypto]")
 {
 	auto [peers, keys] = make_peers();
@@ -49,6 +102,85 @@ TEST_CASE("Check that incomplete QuorumCert is rejected", "[crypto]")
 	REQUIRE(result.kind() == Crypto::VerifyResult::NOT_A_QUORUM);
 }
 
+TEST_CASE("Check that QuorumCert is verified in parallel", "[crypto]")
+{
+	auto [peers, keys] = make_peers(7);
+	VerifyOptions options;
+	options.num_threads = 4;
+	Crypto crypto(1, keys.at(1), peers, options);
+
+	Hash other_hash = GENESIS.hash();
+	other_hash[0]++;
+
+	// signatures from 5 and 6 are for a different block
+	auto qc = make_qc(peers, keys, {2, 3, 4}, GENESIS.hash());
+	std::vector<Signature> signatures;
+	for (ID id : {2, 5, 3, 6, 4})
+	{
+		Crypto signer(id, keys.at(id), peers);
+		signatures.push_back(signer.sign(id == 5 || id == 6 ? other_hash : GENESIS.hash()));
+	}
+	QuorumCert mixed_qc(GENESIS.hash(), 1, signatures);
+
+	REQUIRE(crypto.verify(qc, 3).ok());
+	REQUIRE(crypto.verify(mixed_qc, 3).ok());
+
+	auto result = crypto.verify(mixed_qc, 4);
+	REQUIRE(result.kind() == Crypto::VerifyResult::NOT_A_QUORUM);
+
+	std::vector<ID> failed;
+	for (auto [id, kind] : result.failures())
+	{
+		REQUIRE(kind == Crypto::VerifyResult::INVALID_SIGNATURE);
+		failed.push_back(id);
+	}
+	std::sort(failed.begin(), failed.end());
+	REQUIRE(failed == std::vector<ID>{5, 6});
+}
+
+TEST_CASE("Check that verified QuorumCerts are cached", "[crypto]")
+{
+	auto [peers, keys] = make_peers();
+	Crypto crypto(1, keys.at(1), peers);
+
+	std::vector<Signature> signatures;
+	for (ID id : {2, 3, 4})
+	{
+		signatures.push_back(Crypto(id, keys.at(id), peers).sign(GENESIS.hash()));
+	}
+	QuorumCert qc(GENESIS.hash(), 1, signatures);
+	QuorumCert reordered_qc(GENESIS.hash(), 1, {signatures[2], signatures[1], signatures[0]});
+
+	REQUIRE(crypto.verify(qc, 3).ok());
+	REQUIRE(crypto.cache_stats().qc_misses == 1);
+	REQUIRE(crypto.cache_stats().signature_misses == 3);
+
+	REQUIRE(crypto.verify(reordered_qc, 3).ok());
+	REQUIRE(crypto.cache_stats().qc_hits == 1);
+
+	// a cached certificate does not satisfy a larger quorum
+	REQUIRE(!crypto.verify(qc, 4).ok());
+
+	// nor does it vouch for another one with the same signers, but other signatures
+	Hash other_hash = GENESIS.hash();
+	other_hash[0]++;
+	std::vector<Signature> forged;
+	for (ID id : {2, 3, 4})
+	{
+		forged.push_back(Crypto(id, keys.at(id), peers).sign(other_hash));
+	}
+	REQUIRE(!crypto.verify(QuorumCert(GENESIS.hash(), 1, forged), 3).ok());
+
+	// signatures that were checked as part of a certificate are cached too
+	Crypto signer(2, keys.at(2), peers);
+	auto signature = signer.sign(other_hash);
+	REQUIRE(crypto.verify(QuorumCert(other_hash, 1, {signature}), 1).ok());
+
+	auto stats = crypto.cache_stats();
+	REQUIRE(crypto.verify(signature, other_hash).ok());
+	REQUIRE(crypto.cache_stats().signature_hits == stats.signature_hits + 1);
+}
+
 TEST_CASE("Serialize/Deserialize QuorumCert", "[crypto,serialization]")
 {
 	std::stringstream ss;
@@ -71,3 +203,79 @@ TEST_CASE("Serialize/Deserialize QuorumCert", "[crypto,serialization]")
 
 	REQUIRE(qc.round() == 1);
 }
+
+TEST_CASE("QuorumCert stores signers as a bitmap", "[crypto]")
+{
+	auto [peers, keys] = make_peers(7);
+
+	std::vector<Signature> signatures;
+	for (ID id : {5, 2, 7, 2})
+	{
+		Crypto signer(id, keys.at(id), peers);
+		signatures.push_back(signer.sign(GENESIS.hash()));
+	}
+	QuorumCert qc(GENESIS.hash(), 1, signatures);
+
+	// the duplicate signature of 2 is dropped
+	REQUIRE(qc.num_signers() == 3);
+	REQUIRE(qc.signers() == std::vector<ID>{2, 5, 7});
+	REQUIRE(qc.has_signer(5));
+	REQUIRE(!qc.has_signer(3));
+	REQUIRE(!qc.has_signer(1000));
+
+	Crypto crypto(1, keys.at(1), peers);
+	REQUIRE(crypto.verify(qc, 3).ok());
+}
+
+TEST_CASE("QuorumCert encoding is compact", "[crypto,serialization]")
+{
+	auto [peers, keys] = make_peers(16);
+	std::vector<ID> signers;
+	std::vector<Signature> signatures;
+	for (ID id = 1; id <= 11; id++)
+	{
+		Crypto signer(id, keys.at(id), peers);
+		signers.push_back(id);
+		signatures.push_back(signer.sign(GENESIS.hash()));
+	}
+	QuorumCert qc(GENESIS.hash(), 1, signatures);
+
+	std::stringstream ss;
+	{
+		cereal::BinaryOutputArchive oarchive(ss);
+		oarchive(qc);
+	}
+	QuorumCert decoded;
+	{
+		cereal::BinaryInputArchive iarchive(ss);
+		iarchive(decoded);
+	}
+	REQUIRE(decoded.signers() == signers);
+	REQUIRE(decoded.signer_set() == qc.signer_set());
+
+	Crypto crypto(1, keys.at(1), peers);
+	REQUIRE(crypto.verify(decoded, 11).ok());
+
+	// smaller than a list of signatures, each with its own length and signer
+	SizeArchive qc_size;
+	qc_size(qc);
+	SizeArchive list_size;
+	list_size(signatures, qc.block_hash(), qc.round());
+	REQUIRE(qc_size.size() < list_size.size());
+}
+
+TEST_CASE("Reject QuorumCert whose signatures do not match its signers", "[crypto,serialization]")
+{
+	std::vector<uint8_t> buffer;
+	{
+		Bitset signers;
+		signers.set(2);
+		signers.set(3);
+		BufferOutputArchive oarchive(buffer);
+		oarchive(signers, std::vector<uint8_t>(65), Hash(), Round(1));
+	}
+
+	QuorumCert qc;
+	BufferInputArchive iarchive(buffer);
+	REQUIRE_THROWS_AS(iarchive(qc), cereal::Exception);
+}
@@ -0,0 +1,68 @@
+#include "leader_election.h"
+
+namespace HotStuff
+{
+
+LeaderElection::LeaderElection(int num_replicas, LeaderElectionOptions options)
+    : m_num_replicas(num_replicas), m_options(options)
+{
+}
+
+ID LeaderElection::get_leader(Round round)
+{
+	if (m_options.reputation_window == 0)
+	{
+		return (ID)round % m_num_replicas;
+	}
+
+	Bitset active;
+	size_t num_blocks = 0;
+	for (auto iter = m_committed.rbegin(); iter != m_committed.rend() && num_blocks < m_options.reputation_window;
+	     iter++)
+	{
+		if (iter->round + m_options.exclude_rounds > round)
+		{
+			continue;
+		}
+
+		iter->replicas.for_each([&](size_t id) { active.set(id); });
+		num_blocks++;
+	}
+
+	size_t num_active = active.count();
+	if (num_active == 0)
+	{
+		return (ID)round % m_num_replicas;
+	}
+
+	// The active replicas take turns, in ascending order of ID.
+	size_t index = round % num_active;
+	ID leader = 0;
+	active.for_each([&](size_t id) {
+		if (index-- == 0)
+		{
+			leader = id;
+		}
+	});
+	return leader;
+}
+
+void LeaderElection::update(const Block &block)
+{
+	if (m_options.reputation_window == 0)
+	{
+		return;
+	}
+
+	Activity activity{block.round(), block.cert().signer_set()};
+	activity.replicas.set(block.proposer());
+	m_committed.push_back(std::move(activity));
+
+	// Blocks from the last exclude_rounds rounds do not count yet, and there is at most one block per round.
+	while (m_committed.size() > m_options.reputation_window + m_options.exclude_rounds)
+	{
+		m_committed.pop_front();
+	}
+}
+
+} // namespace HotStuff
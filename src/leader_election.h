@@ -0,0 +1,55 @@
+#pragma once
+
+#include <deque>
+
+#include "blockchain.h"
+#include "types.h"
+#include "util/bitset.h"
+
+namespace HotStuff
+{
+
+class LeaderElectionOptions
+{
+  public:
+	// If zero, the replicas take turns as leader in round-robin order. Otherwise, only the replicas that proposed a
+	// block or signed a QC in this many of the most recently committed blocks take turns.
+	size_t reputation_window = 0;
+	// The leader of round r is picked based on the blocks committed in rounds up to r - exclude_rounds, which every
+	// replica that keeps up has committed by the time it needs to know the leader of round r.
+	Round exclude_rounds = 4;
+};
+
+// Picks the leader of each round.
+//
+// With round-robin election, a crashed replica costs a timeout each time its turn comes up. Leader reputation skips
+// replicas that have not recently shown signs of life in the committed chain, i.e. neither proposed a committed block
+// nor signed a QC in one. Since every replica sees the same committed chain, they agree on the leaders, as long as
+// they have committed the blocks that the choice is based on; a replica that lags behind may expect a different
+// leader, which costs liveness but never safety. A replica that recovers is back in the rotation once its votes show
+// up in QCs again.
+class LeaderElection
+{
+  public:
+	LeaderElection(int num_replicas, LeaderElectionOptions options = {});
+	ID get_leader(Round round);
+
+	// Records a committed block. Blocks must be passed in the order in which they are committed.
+	void update(const Block &block);
+
+  private:
+	// The replicas that showed signs of life in a committed block.
+	class Activity
+	{
+	  public:
+		Round round;
+		Bitset replicas;
+	};
+
+	int m_num_replicas;
+	LeaderElectionOptions m_options;
+	// The most recently committed blocks, oldest first.
+	std::deque<Activity> m_committed;
+};
+
+} // namespace HotStuff
@@ -0,0 +1,102 @@
+#include <catch2/catch_test_macros.hpp>
+#include <chrono>
+#include <fmt/core.h>
+
+#include "leader_election.h"
+#include "safety_rules.h"
+#include "tests/util.h"
+
+using namespace HotStuff;
+using namespace std::chrono_literals;
+
+class SimulationResult
+{
+  public:
+	size_t num_committed = 0;
+	size_t num_timeouts = 0;
+	std::chrono::milliseconds time{0};
+
+	double throughput() const
+	{
+		return num_committed / std::chrono::duration<double>(time).count();
+	}
+};
+
+// Simulates the happy path of the chained HotStuff protocol, in which a round takes a round-trip if its leader is
+// alive, and times out if it has crashed.
+static SimulationResult simulate(int num_replicas, int num_crashed, LeaderElectionOptions options, Round num_rounds)
+{
+	const auto round_trip = 10ms;
+	// what the pacemaker settles on for this round-trip
+	const auto timeout = 50ms;
+	const int quorum_size = num_replicas - (num_replicas - 1) / 3;
+
+	auto [peers, keys] = make_peers(num_replicas, 0);
+	std::vector<std::shared_ptr<Crypto>> replicas;
+	for (ID id = 0; id < static_cast<ID>(num_replicas); id++)
+	{
+		replicas.push_back(std::make_shared<Crypto>(id, keys.at(id), peers));
+	}
+	// the replicas with the highest IDs have crashed
+	auto crashed = [&](ID id) { return id >= static_cast<ID>(num_replicas - num_crashed); };
+
+	auto chain = std::make_shared<BlockChain>();
+	auto parent = chain->get(GENESIS.hash());
+	SafetyRules rules(chain, parent);
+	LeaderElection election(num_replicas, options);
+	QuorumCert cert = GENESIS_QC;
+	SimulationResult result;
+
+	for (Round round = 1; round <= num_rounds; round++)
+	{
+		ID leader = election.get_leader(round);
+		if (crashed(leader))
+		{
+			result.time += timeout;
+			result.num_timeouts++;
+			continue;
+		}
+
+		auto block = std::make_shared<const Block>(parent->hash(), round, leader, cert);
+		chain->add(block);
+		result.time += round_trip;
+
+		std::vector<Signature> votes;
+		for (ID id = 0; votes.size() < static_cast<size_t>(quorum_size); id++)
+		{
+			votes.push_back(replicas[id]->sign(block->hash()));
+		}
+		cert = QuorumCert(block->hash(), round, std::move(votes));
+
+		for (auto &committed : rules.update(cert))
+		{
+			election.update(*committed);
+			result.num_committed++;
+		}
+		parent = block;
+	}
+
+	return result;
+}
+
+TEST_CASE("Throughput with crashed replicas", "[leader_election][benchmark]")
+{
+	const Round num_rounds = 300;
+
+	for (int num_replicas : {4, 7, 10})
+	{
+		int num_crashed = (num_replicas - 1) / 3;
+		LeaderElectionOptions round_robin;
+		LeaderElectionOptions reputation;
+		reputation.reputation_window = 2 * num_replicas;
+
+		auto without = simulate(num_replicas, num_crashed, round_robin, num_rounds);
+		auto with = simulate(num_replicas, num_crashed, reputation, num_rounds);
+
+		fmt::print("{} replicas, {} crashed, {} rounds:\n", num_replicas, num_crashed, num_rounds);
+		fmt::print("  round-robin: {:.1f} blocks/s, {} timeouts\n", without.throughput(), without.num_timeouts);
+		fmt::print("  reputation:  {:.1f} blocks/s, {} timeouts\n", with.throughput(), with.num_timeouts);
+
+		REQUIRE(with.throughput() > without.throughput());
+	}
+}
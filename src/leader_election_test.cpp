@@ -0,0 +1,64 @@
+#include <catch2/catch_test_macros.hpp>
+#include <set>
+
+#include "leader_election.h"
+#include "tests/util.h"
+
+using namespace HotStuff;
+
+TEST_CASE("Leaders take turns in round-robin order by default", "[leader_election]")
+{
+	auto [peers, keys] = make_peers(4, 0);
+	LeaderElection election(4);
+
+	election.update(Block(GENESIS.hash(), 1, 1, make_qc(peers, keys, {0, 1, 2}, GENESIS.hash(), 0)));
+	for (Round round = 0; round < 8; round++)
+	{
+		REQUIRE(election.get_leader(round) == round % 4);
+	}
+}
+
+TEST_CASE("Skip leaders that do not show up in committed blocks", "[leader_election]")
+{
+	// replica 3 has crashed, so it neither proposes nor votes
+	auto [peers, keys] = make_peers(4, 0);
+	LeaderElectionOptions options;
+	options.reputation_window = 5;
+	options.exclude_rounds = 4;
+	LeaderElection election(4, options);
+	LeaderElection other(4, options);
+
+	// nothing is committed yet
+	REQUIRE(election.get_leader(3) == 3);
+
+	auto commit = [&, &peers = peers, &keys = keys](Round round, ID proposer, std::vector<ID> signers) {
+		Block block(GENESIS.hash(), round, proposer, make_qc(peers, keys, signers, GENESIS.hash(), round - 1));
+		election.update(block);
+		other.update(block);
+	};
+	for (Round round = 1; round <= 10; round++)
+	{
+		commit(round, round % 3, {0, 1, 2});
+	}
+
+	std::set<ID> leaders;
+	for (Round round = 11; round <= 30; round++)
+	{
+		ID leader = election.get_leader(round);
+		leaders.insert(leader);
+		// replicas that saw the same committed blocks agree
+		REQUIRE(other.get_leader(round) == leader);
+	}
+	REQUIRE(leaders == std::set<ID>{0, 1, 2});
+
+	// replica 3 recovers, and its vote makes it into a QC
+	commit(11, 2, {1, 2, 3});
+	// the block is too recent to count before round 15
+	std::set<ID> before;
+	for (Round round = 12; round <= 14; round++)
+	{
+		before.insert(election.get_leader(round));
+	}
+	REQUIRE(before.count(3) == 0);
+	REQUIRE(election.get_leader(15) == 3);
+}
@@ -0,0 +1,162 @@
+#include <botan/sha2_32.h>
+#include <cereal/types/vector.hpp>
+
+#include "mempool.h"
+#include "util/buffer_archive.h"
+
+namespace HotStuff
+{
+
+static Hash transaction_hash(const Transaction &transaction)
+{
+	Hash hash;
+	Botan::SHA_256 hasher;
+	hasher.update(transaction.data(), transaction.size());
+	hasher.final(hash.data());
+	return hash;
+}
+
+Mempool::Mempool(MempoolOptions options) : m_options(options)
+{
+}
+
+bool Mempool::submit(Transaction transaction)
+{
+	if (sizeof(cereal::size_type) + encoded_size(transaction) > m_options.max_payload_bytes)
+	{
+		return false;
+	}
+
+	auto hash = transaction_hash(transaction);
+	m_queue.push(Entry{hash, Clock::now(), std::move(transaction)});
+	return true;
+}
+
+bool Mempool::ready(Clock::time_point now)
+{
+	drain();
+	return full() || (!m_pending.empty() && now >= m_pending.front().submitted + m_options.max_delay);
+}
+
+std::optional<Mempool::Clock::time_point> Mempool::deadline()
+{
+	drain();
+	if (m_pending.empty())
+	{
+		return std::nullopt;
+	}
+	return m_pending.front().submitted + m_options.max_delay;
+}
+
+std::vector<uint8_t> Mempool::take_payload()
+{
+	drain();
+	if (m_pending.empty())
+	{
+		return {};
+	}
+
+	std::vector<Transaction> transactions;
+	// the number of transactions comes first
+	size_t num_bytes = sizeof(cereal::size_type);
+	while (!m_pending.empty() && transactions.size() < m_options.max_payload_transactions)
+	{
+		auto &transaction = m_pending.front().transaction;
+		size_t size = encoded_size(transaction);
+		if (num_bytes + size > m_options.max_payload_bytes)
+		{
+			break;
+		}
+
+		num_bytes += size;
+		m_pending_bytes -= size;
+		transactions.push_back(std::move(transaction));
+		m_pending.pop_front();
+	}
+
+	return serialize_to_buffer(transactions);
+}
+
+size_t Mempool::num_pending() const
+{
+	return m_pending.size();
+}
+
+std::vector<Transaction> Mempool::decode(const std::vector<uint8_t> &payload)
+{
+	std::vector<Transaction> transactions;
+	if (payload.empty())
+	{
+		return transactions;
+	}
+
+	// The sizes are checked against the bytes that are left, so that a forged payload cannot make this allocate more
+	// than the payload itself.
+	BufferInputArchive archive(payload);
+	cereal::size_type num_transactions;
+	archive(cereal::make_size_tag(num_transactions));
+	if (num_transactions > archive.remaining() / sizeof(cereal::size_type))
+	{
+		throw cereal::Exception("payload is too short for its number of transactions");
+	}
+
+	transactions.resize(num_transactions);
+	for (auto &transaction : transactions)
+	{
+		cereal::size_type size;
+		archive(cereal::make_size_tag(size));
+		if (size > archive.remaining())
+		{
+			throw cereal::Exception("payload is too short for its transactions");
+		}
+
+		transaction.resize(size);
+		archive(cereal::binary_data(transaction.data(), size));
+	}
+
+	if (archive.remaining() > 0)
+	{
+		throw cereal::Exception("payload has trailing bytes");
+	}
+	return transactions;
+}
+
+size_t Mempool::encoded_size(const Transaction &transaction)
+{
+	return sizeof(cereal::size_type) + transaction.size();
+}
+
+bool Mempool::full() const
+{
+	return m_pending.size() >= m_options.max_payload_transactions ||
+	       sizeof(cereal::size_type) + m_pending_bytes >= m_options.max_payload_bytes;
+}
+
+void Mempool::drain()
+{
+	while (!full())
+	{
+		auto entry = m_queue.pop();
+		if (!entry)
+		{
+			return;
+		}
+
+		if (!m_seen.insert(entry->hash, true).second)
+		{
+			continue;
+		}
+
+		m_seen_order.push_back(entry->hash);
+		if (m_seen_order.size() > m_options.dedup_window)
+		{
+			m_seen.erase(m_seen_order.front());
+			m_seen_order.pop_front();
+		}
+
+		m_pending_bytes += encoded_size(entry->transaction);
+		m_pending.push_back(std::move(*entry));
+	}
+}
+
+} // namespace HotStuff
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <optional>
+#include <vector>
+
+#include "crypto.h"
+#include "network.h"
+#include "util/flat_hash_map.h"
+#include "util/mpsc_queue.h"
+
+namespace HotStuff
+{
+
+typedef std::vector<uint8_t> Transaction;
+
+// The room that a proposal leaves for everything besides its payload: the block's header and its QC, whose signatures
+// take up a few kB for a hundred replicas.
+const size_t PROPOSAL_HEADROOM = 64 * 1024; // 64kiB
+
+class MempoolOptions
+{
+  public:
+	// A payload is ready as soon as the pending transactions fill it, by size or by count...
+	// The size is that of the encoded payload, which must fit into a proposal.
+	size_t max_payload_bytes = MAX_MESSAGE_SIZE - PROPOSAL_HEADROOM;
+	size_t max_payload_transactions = 10000;
+	// ... or once the oldest pending transaction has waited this long.
+	std::chrono::milliseconds max_delay{10};
+	// Number of recent transaction hashes that are remembered to drop duplicates.
+	size_t dedup_window = 1024 * 1024;
+};
+
+// Collects transactions from clients and batches them into block payloads.
+//
+// Clients submit transactions from any number of threads through a lock-free queue, and hash them on their own
+// thread. The leader drains the queue only as far as it needs to fill the next payload, dropping transactions whose
+// hash it has seen recently, and cuts a payload once it is full or its oldest transaction has waited long enough.
+// A payload is the serialization of a vector of transactions (see decode).
+//
+// submit() is thread safe. Everything else must only be called from a single thread, e.g. the leader's.
+class Mempool
+{
+  public:
+	typedef std::chrono::steady_clock Clock;
+
+	Mempool(MempoolOptions options = {});
+
+	// Never blocks. Returns false, and drops the transaction, if it is too large to fit into a payload by itself.
+	bool submit(Transaction transaction);
+
+	// Returns true if a payload is full, or if the oldest pending transaction has waited max_delay.
+	bool ready(Clock::time_point now = Clock::now());
+	// Returns when the oldest pending transaction will have waited max_delay, or nullopt if none are pending.
+	std::optional<Clock::time_point> deadline();
+	// Returns a payload of the oldest pending transactions, up to the limits. The payload may be empty.
+	std::vector<uint8_t> take_payload();
+
+	// Number of transactions that were taken from the queue but have not gone into a payload yet.
+	size_t num_pending() const;
+
+	// Returns the transactions in a payload. Throws cereal::Exception if the payload is malformed.
+	static std::vector<Transaction> decode(const std::vector<uint8_t> &payload);
+
+  private:
+	class Entry
+	{
+	  public:
+		Hash hash;
+		Clock::time_point submitted;
+		Transaction transaction;
+	};
+
+	MempoolOptions m_options;
+	MPSCQueue<Entry> m_queue;
+
+	// Transactions that were taken from the queue, oldest first.
+	std::deque<Entry> m_pending;
+	// The size of the pending transactions in a payload.
+	size_t m_pending_bytes = 0;
+	// The hashes of recent transactions, and the order in which they are forgotten.
+	FlatHashMap<Hash, bool> m_seen;
+	std::deque<Hash> m_seen_order;
+
+	// Returns the number of bytes that a transaction takes up in a payload.
+	static size_t encoded_size(const Transaction &transaction);
+	bool full() const;
+	// Moves transactions from the queue to m_pending until a payload is full or the queue is empty.
+	void drain();
+};
+
+} // namespace HotStuff
@@ -0,0 +1,53 @@
+#include <catch2/benchmark/catch_benchmark.hpp>
+#include <catch2/catch_test_macros.hpp>
+#include <cstring>
+#include <fmt/core.h>
+#include <thread>
+
+#include "mempool.h"
+
+using namespace HotStuff;
+
+TEST_CASE("Batch transactions", "[mempool][benchmark]")
+{
+	const uint32_t num_transactions = 100000;
+	const size_t transaction_size = 100;
+
+	for (uint32_t num_threads : {1, 4})
+	{
+		// from submission by the clients to the last payload
+		BENCHMARK(fmt::format("{} transactions of {} bytes from {} threads", num_transactions, transaction_size,
+		                      num_threads))
+		{
+			Mempool mempool;
+			std::vector<std::thread> threads;
+			for (uint32_t t = 0; t < num_threads; t++)
+			{
+				threads.emplace_back([&, t]() {
+					for (uint32_t i = t; i < num_transactions; i += num_threads)
+					{
+						Transaction transaction(transaction_size);
+						std::memcpy(transaction.data(), &i, sizeof(i));
+						mempool.submit(std::move(transaction));
+					}
+				});
+			}
+
+			size_t num_payloads = 0;
+			for (size_t num_taken = 0; num_taken < num_transactions;)
+			{
+				if (mempool.ready())
+				{
+					num_taken += Mempool::decode(mempool.take_payload()).size();
+					num_payloads++;
+				}
+			}
+
+			for (auto &thread : threads)
+			{
+				thread.join();
+			}
+			return num_payloads;
+		};
+	}
+}
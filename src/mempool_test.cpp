@@ -0,0 +1,186 @@
+#include <catch2/catch_test_macros.hpp>
+#include <cereal/cereal.hpp>
+#include <chrono>
+#include <numeric>
+#include <set>
+#include <thread>
+
+#include "mempool.h"
+#include "tests/util.h"
+#include "util/buffer_archive.h"
+
+using namespace HotStuff;
+using namespace std::chrono_literals;
+
+static Transaction make_transaction(uint32_t id, size_t size = 100)
+{
+	Transaction transaction(size, 0);
+	std::memcpy(transaction.data(), &id, sizeof(id));
+	return transaction;
+}
+
+TEST_CASE("Cut a payload once it is full or has waited long enough", "[mempool]")
+{
+	MempoolOptions options;
+	options.max_delay = 10ms;
+	std::vector<size_t> sizes;
+
+	SECTION("Limit the number of transactions")
+	{
+		options.max_payload_transactions = 3;
+		sizes = {3, 3, 1};
+	}
+	SECTION("Limit the number of bytes")
+	{
+		options.max_payload_bytes = 250;
+		sizes = {2, 2, 2, 1};
+	}
+
+	Mempool mempool(options);
+	REQUIRE(!mempool.ready());
+	REQUIRE(!mempool.deadline());
+	REQUIRE(mempool.take_payload().empty());
+
+	auto start = Mempool::Clock::now();
+	for (uint32_t id = 0; id < 7; id++)
+	{
+		mempool.submit(make_transaction(id));
+	}
+
+	uint32_t next = 0;
+	for (size_t i = 0; i < sizes.size(); i++)
+	{
+		// the last payload is not full, so it waits for the oldest transaction to be old enough
+		bool last = i + 1 == sizes.size();
+		REQUIRE(mempool.ready(start) == !last);
+		if (last)
+		{
+			REQUIRE(*mempool.deadline() >= start + options.max_delay);
+			REQUIRE(mempool.ready(*mempool.deadline()));
+		}
+
+		auto transactions = Mempool::decode(mempool.take_payload());
+		REQUIRE(transactions.size() == sizes[i]);
+		for (auto &transaction : transactions)
+		{
+			REQUIRE(transaction == make_transaction(next++));
+		}
+	}
+
+	REQUIRE(mempool.num_pending() == 0);
+	REQUIRE(!mempool.ready(start + 1s));
+}
+
+TEST_CASE("A full payload fits into a proposal", "[mempool]")
+{
+	MempoolOptions options;
+	Mempool mempool(options);
+
+	// the payload starts with the number of transactions, and each transaction with its size
+	size_t max_size = options.max_payload_bytes - 2 * sizeof(cereal::size_type);
+	REQUIRE(!mempool.submit(make_transaction(0, max_size + 1)));
+	REQUIRE(mempool.submit(make_transaction(0, max_size)));
+	REQUIRE(mempool.take_payload().size() == options.max_payload_bytes);
+
+	for (uint32_t id = 1; id <= 2000; id++)
+	{
+		REQUIRE(mempool.submit(make_transaction(id, 900 + id % 200)));
+	}
+	REQUIRE(mempool.ready());
+	auto payload = mempool.take_payload();
+	REQUIRE(payload.size() <= options.max_payload_bytes);
+	REQUIRE(payload.size() > options.max_payload_bytes - 1200);
+
+	// a QC of a hundred replicas
+	auto [peers, keys] = make_peers(100);
+	std::vector<ID> signers(67);
+	std::iota(signers.begin(), signers.end(), 1);
+	auto qc = make_qc(peers, keys, signers, GENESIS.hash(), 1);
+	Block block(GENESIS.hash(), 2, 1, qc, std::move(payload));
+	REQUIRE(serialize_to_buffer(block).size() <= MAX_MESSAGE_SIZE);
+}
+
+TEST_CASE("Drop duplicate transactions", "[mempool]")
+{
+	MempoolOptions options;
+	options.dedup_window = 3;
+	Mempool mempool(options);
+
+	mempool.submit(make_transaction(1));
+	mempool.submit(make_transaction(2));
+	mempool.submit(make_transaction(1));
+	REQUIRE(Mempool::decode(mempool.take_payload()) ==
+	        std::vector<Transaction>{make_transaction(1), make_transaction(2)});
+
+	// the transaction is remembered after it has gone into a payload
+	mempool.submit(make_transaction(1));
+	mempool.submit(make_transaction(3));
+	mempool.submit(make_transaction(4));
+	REQUIRE(Mempool::decode(mempool.take_payload()) ==
+	        std::vector<Transaction>{make_transaction(3), make_transaction(4)});
+
+	// until it falls out of the window
+	mempool.submit(make_transaction(1));
+	REQUIRE(Mempool::decode(mempool.take_payload()) == std::vector<Transaction>{make_transaction(1)});
+}
+
+TEST_CASE("Accept transactions from many threads", "[mempool]")
+{
+	const uint32_t num_threads = 4;
+	const uint32_t num_per_thread = 5000;
+	MempoolOptions options;
+	options.max_payload_transactions = 1000;
+	Mempool mempool(options);
+
+	std::vector<std::thread> threads;
+	for (uint32_t t = 0; t < num_threads; t++)
+	{
+		threads.emplace_back([&, t]() {
+			for (uint32_t i = 0; i < num_per_thread; i++)
+			{
+				mempool.submit(make_transaction(t * num_per_thread + i, 32));
+			}
+		});
+	}
+
+	std::set<Transaction> received;
+	size_t num_received = 0;
+	while (num_received < num_threads * num_per_thread)
+	{
+		auto transactions = Mempool::decode(mempool.take_payload());
+		REQUIRE(transactions.size() <= options.max_payload_transactions);
+		num_received += transactions.size();
+		received.insert(transactions.begin(), transactions.end());
+	}
+
+	for (auto &thread : threads)
+	{
+		thread.join();
+	}
+
+	REQUIRE(received.size() == num_threads * num_per_thread);
+	REQUIRE(mempool.take_payload().empty());
+}
+
+TEST_CASE("Reject malformed payloads", "[mempool]")
+{
+	Mempool mempool;
+	mempool.submit(make_transaction(1));
+	mempool.submit(make_transaction(2));
+	auto payload = mempool.take_payload();
+	REQUIRE(Mempool::decode(payload).size() == 2);
+
+	SECTION("Truncated")
+	{
+		payload.pop_back();
+	}
+	SECTION("Trailing bytes")
+	{
+		payload.push_back(0);
+	}
+	SECTION("Forged number of transactions")
+	{
+		payload[7] = 0xff;
+	}
+	REQUIRE_THROWS_AS(Mempool::decode(payload), cereal::Exception);
+}
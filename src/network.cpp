@@ -1,15 +1,18 @@
 #include <arpa/inet.h> // htonl
 #include <asio/buffer.hpp>
 #include <asio/connect.hpp>
+#include <asio/post.hpp>
 #include <asio/read.hpp>
-#include <cereal/archives/binary.hpp>
+#include <asio/write.hpp>
+#include <cstring>
 #include <optional>
 #include <spdlog/spdlog.h>
-#include <sstream>
 
 #include "network.h"
+#include "util/buffer_archive.h"
 
-const size_t MAX_MESSAGE_SIZE = 1024 * 1024; // 1MiB
+const size_t MAX_GATHER_BUFFERS = 64;        // max number of frames written by a single gather write
+const size_t MAX_GATHER_BYTES = 256 * 1024;  // a gather write stops taking more frames after this many bytes
 
 namespace HotStuff
 {
@@ -18,7 +21,8 @@ Vote::Vote()
 {
 }
 
-Vote::Vote(Signature signature, Hash block_hash) : m_signature(signature), m_block_hash(block_hash)
+Vote::Vote(Signature signature, Hash block_hash, Round round)
+    : m_signature(signature), m_block_hash(block_hash), m_round(round)
 {
 }
 
@@ -32,11 +36,17 @@ Hash Vote::block_hash()
 	return m_block_hash;
 }
 
+Round Vote::round()
+{
+	return m_round;
+}
+
 Timeout::Timeout()
 {
 }
 
-Timeout::Timeout(Signature signature, Round round) : m_signature(signature), m_round(round)
+Timeout::Timeout(Signature signature, Round round, Round high_qc_round)
+    : m_signature(signature), m_round(round), m_high_qc_round(high_qc_round)
 {
 }
 
@@ -50,6 +60,11 @@ Round Timeout::round()
 	return m_round;
 }
 
+Round Timeout::high_qc_round()
+{
+	return m_high_qc_round;
+}
+
 Network::Header::Header()
 {
 }
@@ -58,48 +73,156 @@ Network::Header::Header(Type type, uint32_t size) : type(type), size(size)
 {
 }
 
+Network::Priority Network::priority(Header::Type type)
+{
+	switch (type)
+	{
+	case Header::Type::VOTE:
+	case Header::Type::TIMEOUT:
+		return URGENT;
+	default:
+		return BULK;
+	}
+}
+
 Network::Sender::Sender(asio::ip::tcp::socket &&socket, std::shared_ptr<Network> network)
-    : m_socket(std::move(socket)), m_network(network)
+    : m_network(network), m_socket(std::move(socket))
 {
+	m_address = m_socket.remote_endpoint().address().to_string();
 }
 
-void Network::Sender::send_message(Header header, std::vector<uint8_t> body)
+bool Network::Sender::send_message(Frame frame, Priority priority)
 {
-	m_socket.async_send(asio::buffer(&header, sizeof(header)),
-	                    [self = shared_from_this(), body = std::move(body)](std::error_code error, size_t _) {
-		                    if (error)
-		                    {
-			                    spdlog::error("error {0} sending header to {2}: {1}", error.value(), error.message(),
-			                                  self->m_socket.remote_endpoint().address().to_string());
-			                    self->m_socket.close();
-			                    return;
-		                    }
+	if (m_closed)
+	{
+		return false;
+	}
 
-		                    self->send_body(std::move(body));
-	                    });
+	const auto &options = m_network->m_send_options;
+	size_t budget = priority == URGENT ? options.max_urgent_bytes : options.max_bulk_bytes;
+	size_t size = frame->size();
+
+	size_t queued = m_queued_bytes[priority].fetch_add(size);
+	if (queued > 0 && queued + size > budget)
+	{
+		m_queued_bytes[priority].fetch_sub(size);
+
+		if (options.overflow_policy == OverflowPolicy::CLOSE)
+		{
+			spdlog::warn("send queue for {} is full, closing connection", m_address);
+			// the pending write, if any, fails when the socket is closed, and then drops the queued frames.
+			asio::post(m_socket.get_executor(), [self = shared_from_this()]() { self->close(); });
+		}
+		else
+		{
+			spdlog::warn("send queue for {} is full, dropping message", m_address);
+		}
+
+		return false;
+	}
+
+	// The queues are only touched from the socket's executor, so that sends from other threads cannot interleave.
+	asio::post(m_socket.get_executor(), [self = shared_from_this(), frame = std::move(frame), priority]() mutable {
+		if (self->m_closed)
+		{
+			self->m_queued_bytes[priority].fetch_sub(frame->size());
+			return;
+		}
+
+		self->m_queues[priority].push_back(std::move(frame));
+		if (self->m_writing.empty())
+		{
+			self->write_queued();
+		}
+	});
+
+	return true;
 }
 
-void Network::Sender::close()
+size_t Network::Sender::queued_bytes() const
 {
-	m_socket.close();
+	size_t total = 0;
+	for (auto &queued : m_queued_bytes)
+	{
+		total += queued;
+	}
+	return total;
 }
 
-void Network::Sender::send_body(std::vector<uint8_t> body)
+void Network::Sender::write_queued()
 {
-	m_socket.async_send(asio::buffer(body), [self = shared_from_this()](std::error_code error, size_t _) {
+	// Gather as many queued frames as possible into a single write, urgent frames first.
+	// The batch is limited in size so that urgent frames do not have to wait for a long run of bulk frames.
+	std::vector<asio::const_buffer> buffers;
+	size_t num_bytes = 0;
+	for (auto &queue : m_queues)
+	{
+		Priority priority = static_cast<Priority>(&queue - m_queues);
+		while (!queue.empty() && buffers.size() < MAX_GATHER_BUFFERS && num_bytes < MAX_GATHER_BYTES)
+		{
+			buffers.push_back(asio::buffer(*queue.front()));
+			num_bytes += queue.front()->size();
+			m_writing.emplace_back(std::move(queue.front()), priority);
+			queue.pop_front();
+		}
+	}
+
+	// The frames are kept alive in m_writing until the write completes.
+	asio::async_write(m_socket, buffers, [self = shared_from_this()](std::error_code error, size_t) {
 		if (error)
 		{
-			spdlog::error("error {0} sending body to {2}: {1}", error.value(), error.message(),
-			              self->m_socket.remote_endpoint().address().to_string());
-			self->m_socket.close();
+			spdlog::error("error {0} sending message to {2}: {1}", error.value(), error.message(), self->m_address);
+			self->close();
+			self->drop_queued();
 			return;
 		}
+
+		for (auto &[frame, priority] : self->m_writing)
+		{
+			self->m_queued_bytes[priority].fetch_sub(frame->size());
+		}
+		self->m_writing.clear();
+
+		for (auto &queue : self->m_queues)
+		{
+			if (!queue.empty())
+			{
+				self->write_queued();
+				break;
+			}
+		}
 	});
 }
 
+void Network::Sender::drop_queued()
+{
+	for (auto &[frame, priority] : m_writing)
+	{
+		m_queued_bytes[priority].fetch_sub(frame->size());
+	}
+	m_writing.clear();
+
+	for (auto &queue : m_queues)
+	{
+		for (auto &frame : queue)
+		{
+			m_queued_bytes[&queue - m_queues].fetch_sub(frame->size());
+		}
+		queue.clear();
+	}
+}
+
+void Network::Sender::close()
+{
+	m_closed = true;
+	m_socket.close();
+}
+
 Network::Receiver::Receiver(asio::ip::tcp::socket &&socket, std::shared_ptr<Network> network)
-    : m_socket(std::move(socket)), m_network(network)
+    : m_network(network), m_socket(std::move(socket))
 {
+	// The address is looked up now, since it can no longer be once the socket is closed.
+	m_address = m_socket.remote_endpoint().address().to_string();
 }
 
 void Network::Receiver::start()
@@ -115,7 +238,7 @@ void Network::Receiver::close()
 void Network::Receiver::recv_header()
 {
 	asio::async_read(m_socket, asio::buffer(&m_header, sizeof(m_header)),
-	                 [self = shared_from_this()](std::error_code error, size_t bytes_transferred) {
+	                 [self = shared_from_this()](std::error_code error, size_t) {
 		                 if (error)
 		                 {
 			                 self->handle_recv_error(error);
@@ -133,29 +256,28 @@ void Network::Receiver::recv_body(Header header)
 {
 	if (header.size > MAX_MESSAGE_SIZE)
 	{
-		spdlog::error("error reading from {1}: message size {0} exceeds limit", header.size,
-		              m_socket.remote_endpoint().address().to_string());
+		spdlog::error("error reading from {1}: message size {0} exceeds limit", header.size, m_address);
 		m_socket.close();
 		return;
 	}
 
-	m_body.emplace();
-	asio::async_read(m_socket, asio::dynamic_buffer(*m_body, header.size),
-	                 [self = shared_from_this(), header](std::error_code error, size_t bytes_transferred) {
+	// m_body is reused between messages, so this only allocates when a message is larger than any seen before.
+	m_body.resize(header.size);
+	asio::async_read(m_socket, asio::buffer(m_body),
+	                 [self = shared_from_this(), header](std::error_code error, size_t) {
 		                 if (error)
 		                 {
 			                 self->handle_recv_error(error);
 			                 return;
 		                 }
-		                 self->m_network->handle_message(header, std::move(*self->m_body));
+		                 self->m_network->handle_message(header, self->m_body);
 		                 self->recv_header();
 	                 });
 }
 
 void Network::Receiver::handle_recv_error(std::error_code error)
 {
-	spdlog::error("error {0} reading from {2}: {1}", error.value(), error.message(),
-	              m_socket.remote_endpoint().address().to_string());
+	spdlog::error("error {0} reading from {2}: {1}", error.value(), error.message(), m_address);
 	m_socket.close();
 }
 
@@ -169,13 +291,23 @@ void Network::Server::async_accept(std::function<void()> callback)
 {
 	m_socket.emplace(m_io_context);
 
-	m_acceptor.async_accept(
-	    *m_socket, [self = shared_from_this(), callback = std::move(callback)](std::error_code error) {
-		    auto recv = std::make_shared<Network::Receiver>(std::move(*self->m_socket), self->m_network);
-		    recv->start();
-		    self->m_network->m_receivers.push_back(recv);
-		    self->async_accept();
-	    });
+	m_acceptor.async_accept(*m_socket, [self = shared_from_this()](std::error_code error) {
+		if (error)
+		{
+			spdlog::error("error {0} accepting connection: {1}", error.value(), error.message());
+			return;
+		}
+		// the connection may have been accepted just before the server was closed
+		if (!self->m_acceptor.is_open())
+		{
+			return;
+		}
+
+		auto recv = std::make_shared<Network::Receiver>(std::move(*self->m_socket), self->m_network);
+		recv->start();
+		self->m_network->m_receivers.push_back(recv);
+		self->async_accept();
+	});
 
 	if (callback)
 		callback();
@@ -191,7 +323,8 @@ void Network::Server::close()
 	m_acceptor.close();
 }
 
-Network::Network(asio::io_context &io_context) : m_io_context(io_context), m_resolver(io_context)
+Network::Network(asio::io_context &io_context, SendOptions send_options)
+    : m_io_context(io_context), m_resolver(io_context), m_send_options(send_options)
 {
 }
 
@@ -203,12 +336,21 @@ void Network::serve(uint16_t port, std::function<void()> callback)
 
 void Network::connect_to(ID id, std::string host, std::string port, std::function<void()> callback)
 {
-	asio::ip::tcp::socket socket(m_io_context);
+	// the socket must outlive this function, as it is used by the pending connect operation
+	auto socket = std::make_shared<asio::ip::tcp::socket>(m_io_context);
 	auto endpoint_iter = m_resolver.resolve(host, port);
-	asio::async_connect(socket, endpoint_iter,
-	                    [&, self = shared_from_this(), callback = std::move(callback)](std::error_code error, auto _) {
-		                    self->m_senders.insert({id, std::make_shared<Sender>(std::move(socket), self)});
-		                    callback();
+	asio::async_connect(*socket, endpoint_iter,
+	                    [id, socket, self = shared_from_this(), callback = std::move(callback)](std::error_code error,
+	                                                                                             auto) {
+		                    if (error)
+		                    {
+			                    spdlog::error("error {0} connecting to {2}: {1}", error.value(), error.message(), id);
+			                    return;
+		                    }
+
+		                    self->m_senders.insert({id, std::make_shared<Sender>(std::move(*socket), self)});
+		                    if (callback)
+			                    callback();
 	                    });
 }
 
@@ -232,24 +374,39 @@ void Network::close()
 	m_server->close();
 }
 
-void Network::send_vote(ID recipient, Vote vote)
+bool Network::send_vote(ID recipient, Vote vote)
+{
+	return send_message<Vote, Header::Type::VOTE>(recipient, vote);
+}
+
+bool Network::send_timeout(ID recipient, Timeout timeout)
 {
-	send_message<Vote, Header::Type::VOTE>(recipient, vote);
+	return send_message<Timeout, Header::Type::TIMEOUT>(recipient, timeout);
 }
 
-void Network::send_timeout(ID recipient, Timeout timeout)
+size_t Network::broadcast_proposal(const Block &proposal)
 {
-	send_message<Timeout, Header::Type::TIMEOUT>(recipient, timeout);
+	return broadcast_message<Block, Header::Type::PROPOSAL>(proposal);
 }
 
-void Network::broadcast_proposal(Block proposal)
+bool Network::send_block_request(ID recipient, const BlockRequest &request)
 {
-	// FIXME: this serializes the block each time it is sent.
-	// Instead, it should be serialized only once and then sent.
-	for (auto [id, _] : m_senders)
+	return send_message<BlockRequest, Header::Type::BLOCK_REQUEST>(recipient, request);
+}
+
+bool Network::send_block_response(ID recipient, const BlockResponse &response)
+{
+	return send_message<BlockResponse, Header::Type::BLOCK_RESPONSE>(recipient, response);
+}
+
+size_t Network::queued_bytes(ID peer)
+{
+	auto sender = m_senders.find(peer);
+	if (sender == m_senders.end())
 	{
-		send_message<Block, Header::Type::PROPOSAL>(id, proposal);
+		return 0;
 	}
+	return sender->second->queued_bytes();
 }
 
 void Network::on_vote(std::function<void(Vote)> callback)
@@ -262,61 +419,120 @@ void Network::on_timeout(std::function<void(Timeout)> callback)
 	m_cb_timeout = callback;
 }
 
-void Network::on_propose(std::function<void(Block)> callback)
+void Network::on_propose(std::function<void(BlockPtr)> callback)
 {
 	m_cb_proposal = callback;
 }
 
-template <typename Message, Network::Header::Type Type> void Network::send_message(ID recipient, Message message)
+void Network::on_block_request(std::function<void(BlockRequest)> callback)
+{
+	m_cb_block_request = callback;
+}
+
+void Network::on_block_response(std::function<void(BlockResponse)> callback)
+{
+	m_cb_block_response = callback;
+}
+
+template <typename Message, Network::Header::Type Type> Network::Frame Network::make_frame(const Message &message)
+{
+	auto frame = serialize_to_buffer(message, sizeof(Header));
+
+	// Convert endianness of message length. The receiver converts it back.
+	Header header(Type, htonl(frame.size() - sizeof(Header)));
+	std::memcpy(frame.data(), &header, sizeof(Header));
+
+	return std::make_shared<const std::vector<uint8_t>>(std::move(frame));
+}
+
+template <typename Message, Network::Header::Type Type>
+bool Network::send_message(ID recipient, const Message &message)
 {
 	auto sender = m_senders.find(recipient);
 	if (sender == m_senders.end())
 	{
 		spdlog::error("unknown recipient {}", recipient);
-		return;
+		return false;
 	}
 
-	// FIXME: this is probably doing multiple unnecessary copies
-	std::stringstream ss;
-	cereal::BinaryOutputArchive oarchive(ss);
+	return sender->second->send_message(make_frame<Message, Type>(message), priority(Type));
+}
 
-	oarchive(message);
-	const std::string &tmp_str = ss.str();
-	std::vector<uint8_t> body(tmp_str.begin(), tmp_str.end());
+template <typename Message, Network::Header::Type Type> size_t Network::broadcast_message(const Message &message)
+{
+	// the message is serialized only once, and the frame is shared by all senders
+	auto frame = make_frame<Message, Type>(message);
 
-	sender->second->send_message(Header(Type, body.size()), std::move(body));
+	size_t num_queued = 0;
+	for (auto &[_, sender] : m_senders)
+	{
+		// the sender logs the messages that it drops
+		if (sender->send_message(frame, priority(Type)))
+		{
+			num_queued++;
+		}
+	}
+	return num_queued;
 }
 
-void Network::handle_message(Header header, std::vector<uint8_t> body)
+void Network::handle_message(Header header, const std::vector<uint8_t> &body)
 {
-	// FIXME: find a better way to deserialize the body
-	std::stringstream ss(std::string(body.begin(), body.end()));
-
-	cereal::BinaryInputArchive iarchive(ss);
+	BufferInputArchive iarchive(body);
 
-	switch (header.type)
+	try
 	{
-	case Header::Type::VOTE: {
-		Vote vote;
-		iarchive(vote);
-		m_cb_vote(vote);
-		break;
-	}
-	case Header::Type::TIMEOUT: {
-		Timeout timeout;
-		iarchive(timeout);
-		m_cb_timeout(timeout);
-		break;
+		switch (header.type)
+		{
+		case Header::Type::VOTE: {
+			Vote vote;
+			iarchive(vote);
+			m_cb_vote(vote);
+			break;
+		}
+		case Header::Type::TIMEOUT: {
+			Timeout timeout;
+			iarchive(timeout);
+			m_cb_timeout(timeout);
+			break;
+		}
+		case Header::Type::PROPOSAL: {
+			auto block = std::make_shared<Block>();
+			iarchive(*block);
+			m_cb_proposal(std::move(block));
+			break;
+		}
+		// replicas that do not take part in catching up ignore these
+		case Header::Type::BLOCK_REQUEST: {
+			BlockRequest request;
+			iarchive(request);
+			if (m_cb_block_request)
+			{
+				m_cb_block_request(std::move(request));
+			}
+			break;
+		}
+		case Header::Type::BLOCK_RESPONSE: {
+			BlockResponse response;
+			iarchive(response);
+			if (m_cb_block_response)
+			{
+				m_cb_block_response(std::move(response));
+			}
+			break;
+		}
+		default:
+			spdlog::error("unknown message type");
+			break;
+		}
 	}
-	case Header::Type::PROPOSAL: {
-		Block block;
-		iarchive(block);
-		m_cb_proposal(block);
-		break;
+	catch (const cereal::Exception &e)
+	{
+		spdlog::error("error decoding message: {}", e.what());
 	}
-	default:
-		spdlog::error("unknown message type");
-		break;
+	// e.g. std::bad_alloc; a message from a peer must never take down the replica
+	catch (const std::exception &e)
+	{
+		spdlog::error("error handling message: {}", e.what());
 	}
 }
 
@@ -2,7 +2,10 @@
 
 #include <asio/io_context.hpp>
 #include <asio/ip/tcp.hpp>
+#include <atomic>
 #include <cereal/access.hpp>
+#include <cereal/cereal.hpp>
+#include <deque>
 #include <functional>
 #include <unordered_map>
 
@@ -13,26 +16,33 @@
 namespace HotStuff
 {
 
+// The largest message body that a receiver accepts. A peer that sends a larger one is disconnected.
+const size_t MAX_MESSAGE_SIZE = 1024 * 1024; // 1MiB
+
 class Vote
 {
   public:
 	// Creates an empty Vote.
 	// You probably shouldn't use this unless you need it for deserialization.
 	Vote();
-	Vote(Signature signature, Hash block_hash);
+	Vote(Signature signature, Hash block_hash, Round round);
 
 	Signature signature();
 	Hash block_hash();
+	// The round of the block. Only the block hash is signed, but votes that carry the wrong round
+	// are collected separately from the others and cannot form a quorum with them.
+	Round round();
 
   private:
 	friend class cereal::access;
 
 	Signature m_signature;
 	Hash m_block_hash;
+	Round m_round;
 
 	template <class Archive> void serialize(Archive &archive)
 	{
-		archive(m_signature, m_block_hash);
+		archive(m_signature, m_block_hash, m_round);
 	}
 };
 
@@ -42,40 +52,129 @@ class Timeout
 	// Creates an empty Timeout.
 	// You probably shouldn't use this unless you need it for deserialization.
 	Timeout();
-	Timeout(Signature signature, Round round);
+	// The signature is on timeout_hash(round, high_qc_round).
+	Timeout(Signature signature, Round round, Round high_qc_round);
 
 	Signature signature();
 	Round round();
+	// The round of the highest QC of the replica that timed out.
+	Round high_qc_round();
 
   private:
 	friend class cereal::access;
 
 	Signature m_signature;
 	Round m_round;
+	Round m_high_qc_round;
 
 	template <class Archive> void serialize(Archive &archive)
 	{
-		archive(m_signature, m_round);
+		archive(m_signature, m_round, m_high_qc_round);
 	}
 };
 
+// Asks a peer for the blocks with rounds in [min_round, max_round] on the chain that ends at head.
+class BlockRequest
+{
+  public:
+	// Connections are one-way, so the recipient needs to know where to send the response.
+	ID requester = 0;
+	// Chosen by the requester to match the response to the request.
+	uint64_t id = 0;
+	Hash head{};
+	Round min_round = 0;
+	Round max_round = 0;
+
+	template <class Archive> void serialize(Archive &archive)
+	{
+		archive(requester, id, head, min_round, max_round);
+	}
+};
+
+class BlockResponse
+{
+  public:
+	uint64_t id = 0;
+	// False if the responder does not know the head of the request.
+	bool found = false;
+	// The response covers the rounds [min_round, max_round] of the request. This is above the requested min_round
+	// if the response was cut short to limit its size.
+	Round min_round = 0;
+	// Newest first, each block being the parent of the one before it.
+	std::vector<BlockPtr> blocks;
+
+	template <class Archive> void save(Archive &archive) const
+	{
+		archive(id, found, min_round, cereal::make_size_tag(static_cast<cereal::size_type>(blocks.size())));
+		for (auto &block : blocks)
+		{
+			archive(*block);
+		}
+	}
+
+	template <class Archive> void load(Archive &archive)
+	{
+		cereal::size_type num_blocks;
+		archive(id, found, min_round, cereal::make_size_tag(num_blocks));
+
+		blocks.clear();
+		for (cereal::size_type i = 0; i < num_blocks; i++)
+		{
+			auto block = std::make_shared<Block>();
+			archive(*block);
+			blocks.push_back(std::move(block));
+		}
+	}
+};
+
+// What to do when a message would exceed the send budget of a peer.
+enum class OverflowPolicy
+{
+	// Drop the message.
+	DROP,
+	// Close the connection to the peer and drop everything queued for it.
+	CLOSE,
+};
+
+// Limits on the amount of data that may be queued for a single peer.
+// Votes and timeouts are urgent, proposals are bulk, and each class has its own budget.
+// A message is always accepted if nothing of its class is queued, even if it is larger than the budget.
+class SendOptions
+{
+  public:
+	size_t max_urgent_bytes = 1024 * 1024;    // 1MiB
+	size_t max_bulk_bytes = 16 * 1024 * 1024; // 16MiB
+	OverflowPolicy overflow_policy = OverflowPolicy::DROP;
+};
+
 class Network : public std::enable_shared_from_this<Network>
 {
   public:
-	Network(asio::io_context &io_context);
+	Network(asio::io_context &io_context, SendOptions send_options = {});
 	void serve(uint16_t port = 0, std::function<void()> callback = {});
 
 	void connect_to(ID id, std::string host, std::string port, std::function<void()> callback = {});
 	uint16_t server_port();
 	void close();
 
-	void send_vote(ID recipient, Vote vote);
-	void send_timeout(ID recipient, Timeout timeout);
-	void broadcast_proposal(Block proposal);
+	// The send methods return false if the message was not queued,
+	// either because the recipient is unknown or because its send budget is exhausted.
+	bool send_vote(ID recipient, Vote vote);
+	bool send_timeout(ID recipient, Timeout timeout);
+	// Returns the number of peers that the proposal was queued for.
+	size_t broadcast_proposal(const Block &proposal);
+	bool send_block_request(ID recipient, const BlockRequest &request);
+	bool send_block_response(ID recipient, const BlockResponse &response);
+
+	// Returns the number of bytes that are queued, but not yet sent, for a peer.
+	// This can be used to slow down when a peer is falling behind.
+	size_t queued_bytes(ID peer);
 
 	void on_vote(std::function<void(Vote)> callback);
 	void on_timeout(std::function<void(Timeout)> callback);
-	void on_propose(std::function<void(Block)> callback);
+	void on_propose(std::function<void(BlockPtr)> callback);
+	void on_block_request(std::function<void(BlockRequest)> callback);
+	void on_block_response(std::function<void(BlockResponse)> callback);
 
   private:
 	class Header
@@ -85,7 +184,9 @@ class Network : public std::enable_shared_from_this<Network>
 		{
 			VOTE,
 			PROPOSAL,
-			TIMEOUT
+			TIMEOUT,
+			BLOCK_REQUEST,
+			BLOCK_RESPONSE,
 		};
 
 		Header();
@@ -95,18 +196,46 @@ class Network : public std::enable_shared_from_this<Network>
 		uint32_t size;
 	};
 
+	enum Priority
+	{
+		URGENT,
+		BULK,
+		NUM_PRIORITIES,
+	};
+
+	static Priority priority(Header::Type type);
+
+	// A serialized message (header followed by body) ready to be written to a socket.
+	// Frames are immutable, so one frame can be shared by all senders that a message is multicast to.
+	typedef std::shared_ptr<const std::vector<uint8_t>> Frame;
+
 	class Sender : public std::enable_shared_from_this<Network::Sender>
 	{
 	  public:
 		Sender(asio::ip::tcp::socket &&socket, std::shared_ptr<Network> network);
-		void send_message(Header header, std::vector<uint8_t> body);
+		// Queues a frame for sending. Returns false if the frame was dropped.
+		// Frames of the same priority are written in the order they were queued,
+		// and queued urgent frames are written before queued bulk frames.
+		bool send_message(Frame frame, Priority priority);
+		size_t queued_bytes() const;
 		void close();
 
 	  private:
 		std::shared_ptr<Network> m_network;
 		asio::ip::tcp::socket m_socket;
-
-		void send_body(std::vector<uint8_t> body);
+		std::string m_address;
+
+		// Frames waiting to be written, per priority. These are only touched on the socket's executor.
+		std::deque<Frame> m_queues[NUM_PRIORITIES];
+		// Frames that are being written right now.
+		std::vector<std::pair<Frame, Priority>> m_writing;
+		// Bytes accepted by send_message that have not been written yet, per priority.
+		// These are updated from the calling thread so that the budget can be checked without waiting on the executor.
+		std::atomic<size_t> m_queued_bytes[NUM_PRIORITIES] = {};
+		std::atomic<bool> m_closed = false;
+
+		void write_queued();
+		void drop_queued();
 	};
 
 	class Receiver : public std::enable_shared_from_this<Network::Receiver>
@@ -119,10 +248,11 @@ class Network : public std::enable_shared_from_this<Network>
 	  private:
 		std::shared_ptr<Network> m_network;
 		asio::ip::tcp::socket m_socket;
+		std::string m_address;
 
 		// storage for reading header / body
 		Network::Header m_header;
-		std::optional<std::vector<uint8_t>> m_body;
+		std::vector<uint8_t> m_body;
 
 		void recv_header();
 		void recv_body(Header header);
@@ -148,6 +278,7 @@ class Network : public std::enable_shared_from_this<Network>
 
 	asio::io_context &m_io_context;
 	asio::ip::tcp::resolver m_resolver;
+	SendOptions m_send_options;
 	std::shared_ptr<Server> m_server;
 
 	std::unordered_map<ID, std::shared_ptr<Sender>> m_senders;
@@ -156,11 +287,15 @@ class Network : public std::enable_shared_from_this<Network>
 	// callbacks
 	std::function<void(Vote)> m_cb_vote;
 	std::function<void(Timeout)> m_cb_timeout;
-	std::function<void(Block)> m_cb_proposal;
+	std::function<void(BlockPtr)> m_cb_proposal;
+	std::function<void(BlockRequest)> m_cb_block_request;
+	std::function<void(BlockResponse)> m_cb_block_response;
 
-	template <typename Message, Header::Type Type> void send_message(ID recipient, Message message);
+	template <typename Message, Header::Type Type> static Frame make_frame(const Message &message);
+	template <typename Message, Header::Type Type> bool send_message(ID recipient, const Message &message);
+	template <typename Message, Header::Type Type> size_t broadcast_message(const Message &message);
 
-	void handle_message(Header header, std::vector<uint8_t> body);
+	void handle_message(Header header, const std::vector<uint8_t> &body);
 };
 
 } // namespace HotStuff
@@ -1,6 +1,8 @@
 #include <asio/io_context.hpp>
+#include <asio/post.hpp>
 #include <catch2/catch_test_macros.hpp>
 #include <chrono>
+#include <optional>
 #include <fmt/core.h>
 #include <thread>
 
@@ -27,9 +29,10 @@ TEST_CASE("Send vote", "[network]")
 {
 	asio::io_context io_context;
 
-	HotStuff::Crypto crypto(1, gen_key(), std::make_shared<Peers>());
+	auto [peers, keys] = make_peers();
+	HotStuff::Crypto crypto(1, keys.at(1), peers);
 	auto sig = crypto.sign(GENESIS.hash());
-	HotStuff::Vote vote(sig, GENESIS.hash());
+	HotStuff::Vote vote(sig, GENESIS.hash(), 1);
 
 	auto net1 = std::make_shared<HotStuff::Network>(io_context);
 	auto net2 = std::make_shared<HotStuff::Network>(io_context);
@@ -44,6 +47,7 @@ TEST_CASE("Send vote", "[network]")
 
 	net1->on_vote([&](HotStuff::Vote vote) {
 		REQUIRE(vote.block_hash() == GENESIS.hash());
+		REQUIRE(vote.round() == 1);
 		REQUIRE(crypto.verify(vote.signature(), vote.block_hash()).ok());
 		cb_fired = true;
 		io_context.stop();
@@ -55,3 +59,215 @@ TEST_CASE("Send vote", "[network]")
 
 	REQUIRE(cb_fired);
 }
+
+TEST_CASE("Broadcast proposal", "[network]")
+{
+	asio::io_context io_context;
+
+	auto [peers, keys] = make_peers();
+	auto qc = make_qc(peers, keys);
+	HotStuff::Block proposal(GENESIS.hash(), 1, 1, qc);
+
+	auto leader = std::make_shared<HotStuff::Network>(io_context);
+	auto replica1 = std::make_shared<HotStuff::Network>(io_context);
+	auto replica2 = std::make_shared<HotStuff::Network>(io_context);
+
+	int num_received = 0;
+
+	auto on_propose = [&](HotStuff::BlockPtr block) {
+		REQUIRE(block->hash() == proposal.hash());
+		if (++num_received == 2)
+		{
+			io_context.stop();
+		}
+	};
+
+	replica1->on_propose(on_propose);
+	replica2->on_propose(on_propose);
+
+	replica1->serve();
+	replica2->serve();
+
+	leader->connect_to(2, "localhost", fmt::format("{}", replica1->server_port()), [&]() {
+		leader->connect_to(3, "localhost", fmt::format("{}", replica2->server_port()),
+		                   [&]() { leader->broadcast_proposal(proposal); });
+	});
+
+	auto thread = std::thread([&]() { REQUIRE_NOTHROW(io_context.run_for(1s)); });
+
+	thread.join();
+
+	REQUIRE(num_received == 2);
+}
+
+TEST_CASE("Send many timeouts in order", "[network]")
+{
+	asio::io_context io_context;
+
+	auto [peers, keys] = make_peers();
+	HotStuff::Crypto crypto(1, keys.at(1), peers);
+	auto sig = crypto.sign(GENESIS.hash());
+
+	const HotStuff::Round num_timeouts = 1000;
+
+	auto net1 = std::make_shared<HotStuff::Network>(io_context);
+	auto net2 = std::make_shared<HotStuff::Network>(io_context);
+
+	net1->serve(0, [&]() {
+		net2->connect_to(1, "localhost", fmt::format("{}", net1->server_port()), [&]() {
+			for (HotStuff::Round round = 0; round < num_timeouts; round++)
+			{
+				net2->send_timeout(1, HotStuff::Timeout(sig, round, 0));
+			}
+		});
+	});
+
+	HotStuff::Round next_round = 0;
+
+	net1->on_timeout([&](HotStuff::Timeout timeout) {
+		REQUIRE(timeout.round() == next_round);
+		if (++next_round == num_timeouts)
+		{
+			io_context.stop();
+		}
+	});
+
+	auto thread = std::thread([&]() { REQUIRE_NOTHROW(io_context.run_for(1s)); });
+
+	thread.join();
+
+	REQUIRE(next_round == num_timeouts);
+}
+
+TEST_CASE("Drop proposals when send budget is exhausted", "[network]")
+{
+	asio::io_context io_context;
+
+	auto [peers, keys] = make_peers();
+	HotStuff::Crypto crypto(1, keys.at(1), peers);
+	auto sig = crypto.sign(GENESIS.hash());
+	auto qc = make_qc(peers, keys);
+
+	HotStuff::SendOptions options;
+	options.max_bulk_bytes = 1;
+
+	auto net1 = std::make_shared<HotStuff::Network>(io_context);
+	auto net2 = std::make_shared<HotStuff::Network>(io_context, options);
+
+	net1->serve(0, [&]() {
+		net2->connect_to(1, "localhost", fmt::format("{}", net1->server_port()), [&]() {
+			// the first proposal is accepted because nothing is queued yet, the second one exceeds the budget
+			REQUIRE(net2->broadcast_proposal(HotStuff::Block(GENESIS.hash(), 1, 1, qc)) == 1);
+			REQUIRE(net2->broadcast_proposal(HotStuff::Block(GENESIS.hash(), 2, 1, qc)) == 0);
+			REQUIRE(net2->queued_bytes(1) > 0);
+			// urgent messages have their own budget
+			REQUIRE(net2->send_timeout(1, HotStuff::Timeout(sig, 1, 0)));
+		});
+	});
+
+	int num_proposals = 0;
+	int num_timeouts = 0;
+
+	net1->on_propose([&](HotStuff::BlockPtr block) {
+		REQUIRE(block->round() == 1);
+		num_proposals++;
+	});
+
+	net1->on_timeout([&](HotStuff::Timeout) { num_timeouts++; });
+
+	auto thread = std::thread([&]() { REQUIRE_NOTHROW(io_context.run_for(200ms)); });
+
+	thread.join();
+
+	REQUIRE(num_proposals == 1);
+	REQUIRE(num_timeouts == 1);
+	REQUIRE(net2->queued_bytes(1) == 0);
+}
+
+TEST_CASE("Close the connection when send budget is exhausted", "[network]")
+{
+	asio::io_context io_context;
+
+	auto [peers, keys] = make_peers();
+	HotStuff::Crypto crypto(1, keys.at(1), peers);
+	auto sig = crypto.sign(GENESIS.hash());
+	auto qc = make_qc(peers, keys);
+
+	HotStuff::SendOptions options;
+	options.max_bulk_bytes = 1;
+	options.overflow_policy = HotStuff::OverflowPolicy::CLOSE;
+
+	auto net1 = std::make_shared<HotStuff::Network>(io_context);
+	auto net2 = std::make_shared<HotStuff::Network>(io_context, options);
+
+	std::optional<bool> sent_after_close;
+	net1->serve(0, [&]() {
+		net2->connect_to(1, "localhost", fmt::format("{}", net1->server_port()), [&]() {
+			REQUIRE(net2->broadcast_proposal(HotStuff::Block(GENESIS.hash(), 1, 1, qc)) == 1);
+			REQUIRE(net2->broadcast_proposal(HotStuff::Block(GENESIS.hash(), 2, 1, qc)) == 0);
+			// the connection is closed on the socket's executor, before this runs
+			asio::post(io_context, [&]() { sent_after_close = net2->send_timeout(1, HotStuff::Timeout(sig, 1, 0)); });
+		});
+	});
+
+	int num_timeouts = 0;
+	net1->on_propose([&](HotStuff::BlockPtr block) { REQUIRE(block->round() == 1); });
+	net1->on_timeout([&](HotStuff::Timeout) { num_timeouts++; });
+
+	auto thread = std::thread([&]() { REQUIRE_NOTHROW(io_context.run_for(200ms)); });
+
+	thread.join();
+
+	REQUIRE(sent_after_close == false);
+	REQUIRE(num_timeouts == 0);
+	REQUIRE(net2->queued_bytes(1) == 0);
+}
+
+TEST_CASE("Send urgent messages before queued bulk ones", "[network]")
+{
+	asio::io_context io_context;
+
+	auto [peers, keys] = make_peers();
+	HotStuff::Crypto crypto(1, keys.at(1), peers);
+	auto sig = crypto.sign(GENESIS.hash());
+	auto qc = make_qc(peers, keys);
+
+	const HotStuff::Round num_proposals = 10;
+
+	auto net1 = std::make_shared<HotStuff::Network>(io_context);
+	auto net2 = std::make_shared<HotStuff::Network>(io_context);
+
+	net1->serve(0, [&]() {
+		net2->connect_to(1, "localhost", fmt::format("{}", net1->server_port()), [&]() {
+			for (HotStuff::Round round = 1; round <= num_proposals; round++)
+			{
+				net2->broadcast_proposal(HotStuff::Block(GENESIS.hash(), round, 1, qc));
+			}
+			net2->send_timeout(1, HotStuff::Timeout(sig, 1, 0));
+		});
+	});
+
+	// the rounds of the messages in the order in which they arrive, with 0 for the timeout
+	std::vector<HotStuff::Round> received;
+	net1->on_propose([&](HotStuff::BlockPtr block) {
+		received.push_back(block->round());
+		if (received.size() == num_proposals + 1)
+		{
+			io_context.stop();
+		}
+	});
+	net1->on_timeout([&](HotStuff::Timeout) {
+		received.push_back(0);
+		if (received.size() == num_proposals + 1)
+		{
+			io_context.stop();
+		}
+	});
+
+	auto thread = std::thread([&]() { REQUIRE_NOTHROW(io_context.run_for(1s)); });
+
+	thread.join();
+
+	// only the first proposal was being written when the timeout was queued, and the others wait behind the timeout
+	REQUIRE(received == std::vector<HotStuff::Round>{1, 0, 2, 3, 4, 5, 6, 7, 8, 9, 10});
+}
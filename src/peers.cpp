@@ -2,33 +2,48 @@
 
 namespace HotStuff
 {
-Peer::Peer(ID id, Botan::ECDSA_PublicKey key) : m_id(id), m_key(key)
+Peer::Peer(ID id, std::shared_ptr<const Botan::Public_Key> key)
+    : m_id(id), m_key(key), m_scheme(signature_scheme_of(*key)), m_verifier(*m_key, signature_padding(m_scheme))
 {
 }
 
-ID Peer::id()
+ID Peer::id() const
 {
 	return m_id;
 }
 
-Botan::ECDSA_PublicKey Peer::public_key()
+const Botan::Public_Key &Peer::public_key() const
 {
-	return m_key;
+	return *m_key;
 }
 
-std::optional<Peer> Peers::find(ID id) const
+SignatureScheme Peer::scheme() const
 {
-	auto peer_entry = m_peers.find(id);
-	if (peer_entry == m_peers.end())
+	return m_scheme;
+}
+
+bool Peer::verify(const uint8_t *msg, size_t msg_len, const uint8_t *sig, size_t sig_len) const
+{
+	std::lock_guard lock(m_verifier_mutex);
+	return m_verifier.verify_message(msg, msg_len, sig, sig_len);
+}
+
+const Peer *Peers::find(ID id) const
+{
+	if (id >= m_peers.size())
 	{
-		return std::nullopt;
+		return nullptr;
 	}
-	return peer_entry->second;
+	return m_peers[id].get();
 }
 
-void Peers::add(Peer peer)
+void Peers::add(ID id, std::shared_ptr<const Botan::Public_Key> key)
 {
-	m_peers.insert({peer.id(), peer});
+	if (id >= m_peers.size())
+	{
+		m_peers.resize(id + 1);
+	}
+	m_peers[id] = std::make_unique<Peer>(id, key);
 }
 
 } // namespace HotStuff
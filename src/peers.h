@@ -1,9 +1,12 @@
 #pragma once
 
-#include <botan/ecdsa.h>
-#include <optional>
-#include <unordered_map>
+#include <botan/pk_keys.h>
+#include <botan/pubkey.h>
+#include <memory>
+#include <mutex>
+#include <vector>
 
+#include "signature_scheme.h"
 #include "types.h"
 
 namespace HotStuff
@@ -12,24 +15,38 @@ namespace HotStuff
 class Peer
 {
   public:
-	Peer(ID id, Botan::ECDSA_PublicKey key);
+	Peer(ID id, std::shared_ptr<const Botan::Public_Key> key);
 
-	ID id();
-	Botan::ECDSA_PublicKey public_key();
+	ID id() const;
+	const Botan::Public_Key &public_key() const;
+	SignatureScheme scheme() const;
+
+	// Verifies a signature made by this peer.
+	// The verifier is created once and reused, so repeated verifications do not have to set up the key again.
+	bool verify(const uint8_t *msg, size_t msg_len, const uint8_t *sig, size_t sig_len) const;
 
   private:
 	ID m_id;
-	Botan::ECDSA_PublicKey m_key;
+	std::shared_ptr<const Botan::Public_Key> m_key;
+	SignatureScheme m_scheme;
+
+	// PK_Verifier is not thread safe.
+	mutable std::mutex m_verifier_mutex;
+	mutable Botan::PK_Verifier m_verifier;
 };
 
+// The set of known peers, indexed by ID.
+// IDs are expected to be small integers, as they are used as indices into a vector.
+// Peers are only added during setup; lookups do not copy anything and may happen from any thread.
 class Peers
 {
   public:
-	std::optional<Peer> find(ID id) const;
-	void add(Peer peer);
+	// Returns the peer with the given ID, or nullptr if there is none.
+	const Peer *find(ID id) const;
+	void add(ID id, std::shared_ptr<const Botan::Public_Key> key);
 
   private:
-	std::unordered_map<ID, Peer> m_peers;
+	std::vector<std::unique_ptr<Peer>> m_peers;
 };
 
 } // namespace HotStuff
@@ -0,0 +1,204 @@
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <future>
+#include <spdlog/spdlog.h>
+#include <system_error>
+#include <unistd.h>
+
+#include "safety_log.h"
+#include "util/buffer_archive.h"
+#include "util/crc32.h"
+
+// Records are aligned to the block size of the disk, so that a record is written in one piece where possible,
+// and so that they can be written with O_DIRECT.
+const size_t SLOT_SIZE = 4096;
+const size_t NUM_SLOTS = 2;
+
+namespace HotStuff
+{
+
+// The layout of a slot: a header, followed by the encoded state.
+class RecordHeader
+{
+  public:
+	uint64_t sequence;
+	uint32_t size;
+	uint32_t checksum;
+};
+
+SafetyLog::SafetyLog(std::string path, SafetyLogOptions options) : m_path(std::move(path)), m_options(options)
+{
+	int flags = O_RDWR | O_CREAT | O_CLOEXEC;
+	m_fd = options.direct_io ? open(m_path.c_str(), flags | O_DIRECT, 0644) : -1;
+	if (m_fd < 0)
+	{
+		if (options.direct_io)
+		{
+			spdlog::warn("cannot open {} with O_DIRECT, falling back to buffered writes", m_path);
+		}
+		m_fd = open(m_path.c_str(), flags, 0644);
+	}
+	if (m_fd < 0)
+	{
+		throw std::system_error(errno, std::generic_category(), "error opening safety log " + m_path);
+	}
+
+	// Preallocating the slots means that syncing a record does not have to update the file's metadata.
+	if (int error = posix_fallocate(m_fd, 0, SLOT_SIZE * NUM_SLOTS); error != 0)
+	{
+		close(m_fd);
+		throw std::system_error(error, std::generic_category(), "error allocating safety log " + m_path);
+	}
+
+	m_buffer = static_cast<uint8_t *>(std::aligned_alloc(SLOT_SIZE, SLOT_SIZE));
+
+	recover();
+
+	m_writer = std::thread([this]() { run(); });
+}
+
+SafetyLog::~SafetyLog()
+{
+	{
+		std::lock_guard lock(m_mutex);
+		m_stop = true;
+	}
+	m_pending_changed.notify_one();
+	m_writer.join();
+
+	close(m_fd);
+	std::free(m_buffer);
+}
+
+const std::optional<SafetyState> &SafetyLog::recovered() const
+{
+	return m_recovered;
+}
+
+void SafetyLog::persist(const SafetyState &state, std::function<void()> on_durable)
+{
+	{
+		std::lock_guard lock(m_mutex);
+		m_pending = state;
+		if (on_durable)
+		{
+			m_pending_callbacks.push_back(std::move(on_durable));
+		}
+	}
+	m_pending_changed.notify_one();
+}
+
+void SafetyLog::persist_sync(const SafetyState &state)
+{
+	std::promise<void> durable;
+	persist(state, [&]() { durable.set_value(); });
+	durable.get_future().wait();
+}
+
+uint64_t SafetyLog::num_writes() const
+{
+	return m_num_writes;
+}
+
+void SafetyLog::recover()
+{
+	std::optional<RecordHeader> latest;
+
+	for (size_t slot = 0; slot < NUM_SLOTS; slot++)
+	{
+		if (pread(m_fd, m_buffer, SLOT_SIZE, slot * SLOT_SIZE) != static_cast<ssize_t>(SLOT_SIZE))
+		{
+			continue;
+		}
+
+		RecordHeader header;
+		std::memcpy(&header, m_buffer, sizeof(header));
+		const uint8_t *data = m_buffer + sizeof(header);
+
+		// an unused slot is all zeros
+		if (header.size == 0 || header.size > SLOT_SIZE - sizeof(header) ||
+		    crc32(data, header.size) != header.checksum)
+		{
+			continue;
+		}
+		if (latest && latest->sequence > header.sequence)
+		{
+			continue;
+		}
+
+		try
+		{
+			SafetyState state;
+			BufferInputArchive iarchive(data, header.size);
+			iarchive(state);
+			m_recovered = state;
+			latest = header;
+		}
+		catch (const cereal::Exception &e)
+		{
+			spdlog::warn("discarding corrupted record in slot {} of {}: {}", slot, m_path, e.what());
+		}
+	}
+
+	m_sequence = latest ? latest->sequence + 1 : 0;
+}
+
+void SafetyLog::run()
+{
+	std::unique_lock lock(m_mutex);
+
+	while (true)
+	{
+		m_pending_changed.wait(lock, [this]() { return m_pending || m_stop; });
+		if (!m_pending)
+		{
+			return;
+		}
+
+		// Everything that was queued up to now is covered by a single write.
+		auto state = *m_pending;
+		auto callbacks = std::move(m_pending_callbacks);
+		m_pending.reset();
+		m_pending_callbacks.clear();
+
+		lock.unlock();
+		write(state);
+		for (auto &callback : callbacks)
+		{
+			callback();
+		}
+		lock.lock();
+	}
+}
+
+void SafetyLog::write(const SafetyState &state)
+{
+	std::vector<uint8_t> data;
+	BufferOutputArchive oarchive(data);
+	oarchive(state);
+
+	RecordHeader header{m_sequence, static_cast<uint32_t>(data.size()), crc32(data.data(), data.size())};
+	std::memset(m_buffer, 0, SLOT_SIZE);
+	std::memcpy(m_buffer, &header, sizeof(header));
+	std::memcpy(m_buffer + sizeof(header), data.data(), data.size());
+
+	size_t offset = (m_sequence % NUM_SLOTS) * SLOT_SIZE;
+	ssize_t written;
+	do
+	{
+		written = pwrite(m_fd, m_buffer, SLOT_SIZE, offset);
+	} while (written < 0 && errno == EINTR);
+
+	if (written != static_cast<ssize_t>(SLOT_SIZE) || (m_options.sync && fdatasync(m_fd) != 0))
+	{
+		spdlog::critical("error writing safety log {}: {}", m_path, std::strerror(errno));
+		std::abort();
+	}
+
+	m_sequence++;
+	m_num_writes++;
+}
+
+} // namespace HotStuff
@@ -0,0 +1,103 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "crypto.h"
+#include "types.h"
+
+namespace HotStuff
+{
+
+// The part of the consensus state that must survive a crash for the replica to stay safe.
+class SafetyState
+{
+  public:
+	Round voted = 0;
+	Round locked_round = 0;
+	Hash locked{};
+	Hash executed{};
+
+	bool operator==(const SafetyState &other) const
+	{
+		return voted == other.voted && locked_round == other.locked_round && locked == other.locked &&
+		       executed == other.executed;
+	}
+
+	template <class Archive> void serialize(Archive &archive)
+	{
+		archive(voted, locked_round, locked, executed);
+	}
+};
+
+class SafetyLogOptions
+{
+  public:
+	// If false, writes are not synced to disk. This is only useful for testing and benchmarking.
+	bool sync = true;
+	// Writes bypass the page cache with O_DIRECT, where the file system supports it.
+	bool direct_io = false;
+};
+
+// A write-ahead log that keeps the latest SafetyState on disk.
+//
+// Updates are written by a background thread with group commit: all updates that arrive while a write is in progress
+// are coalesced, and only the latest of them is written, with a single fsync.
+// Records are written alternately to two fixed slots of a preallocated file, so a write that is torn by a crash
+// never destroys the previous state.
+//
+// An error while writing cannot be recovered from safely, since the replica might vote twice after a restart,
+// so it aborts the process.
+class SafetyLog
+{
+  public:
+	// Throws std::system_error if the file cannot be opened.
+	SafetyLog(std::string path, SafetyLogOptions options = {});
+	// Writes pending updates before returning.
+	~SafetyLog();
+
+	SafetyLog(const SafetyLog &) = delete;
+	SafetyLog &operator=(const SafetyLog &) = delete;
+
+	// Returns the state that was found on disk when the log was opened.
+	const std::optional<SafetyState> &recovered() const;
+
+	// Queues an update. on_durable is called from the log's thread once the update, or a later one, is on disk.
+	// Messages that depend on the update, such as votes, must not be sent before that.
+	void persist(const SafetyState &state, std::function<void()> on_durable = {});
+	// Waits until the update is on disk.
+	void persist_sync(const SafetyState &state);
+
+	// Returns the number of records written so far.
+	uint64_t num_writes() const;
+
+  private:
+	std::string m_path;
+	SafetyLogOptions m_options;
+	int m_fd;
+	// A record is written from an aligned buffer, as O_DIRECT requires.
+	uint8_t *m_buffer;
+	std::optional<SafetyState> m_recovered;
+	// Sequence number of the next record.
+	uint64_t m_sequence = 0;
+	std::atomic<uint64_t> m_num_writes = 0;
+
+	std::mutex m_mutex;
+	std::condition_variable m_pending_changed;
+	std::optional<SafetyState> m_pending;
+	std::vector<std::function<void()>> m_pending_callbacks;
+	bool m_stop = false;
+	std::thread m_writer;
+
+	void recover();
+	void run();
+	void write(const SafetyState &state);
+};
+
+} // namespace HotStuff
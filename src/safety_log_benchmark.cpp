@@ -0,0 +1,47 @@
+#include <catch2/benchmark/catch_benchmark.hpp>
+#include <catch2/catch_test_macros.hpp>
+#include <filesystem>
+#include <fmt/core.h>
+
+#include "safety_log.h"
+
+using namespace HotStuff;
+
+TEST_CASE("Persist safety state", "[safety_log][benchmark]")
+{
+	auto path = std::filesystem::temp_directory_path() / "hotstuff-benchmark-safety";
+	const Round num_rounds = 100;
+
+	for (bool sync : {false, true})
+	{
+		SafetyLogOptions options;
+		options.sync = sync;
+		SafetyLog log(path, options);
+		SafetyState state;
+		auto durability = sync ? "durable" : "not durable";
+
+		// one round at a time, as a replica that waits for each vote to be durable before moving on
+		BENCHMARK(fmt::format("{} rounds, one by one, {}", num_rounds, durability))
+		{
+			for (Round round = 0; round < num_rounds; round++)
+			{
+				state.voted++;
+				log.persist_sync(state);
+			}
+		};
+
+		// updates that arrive while a write is in progress are group committed
+		BENCHMARK(fmt::format("{} rounds, pipelined, {}", num_rounds, durability))
+		{
+			for (Round round = 0; round < num_rounds; round++)
+			{
+				state.voted++;
+				log.persist(state);
+			}
+			state.voted++;
+			log.persist_sync(state);
+		};
+	}
+
+	std::filesystem::remove(path);
+}
@@ -0,0 +1,68 @@
+#include <atomic>
+#include <catch2/catch_test_macros.hpp>
+#include <fstream>
+
+#include "safety_log.h"
+#include "tests/util.h"
+
+using namespace HotStuff;
+
+TEST_CASE("Recover the latest safety state", "[safety_log]")
+{
+	TempDirectory dir;
+	std::filesystem::create_directories(dir.path);
+	auto path = dir.path / "safety";
+
+	SafetyState state;
+	state.locked = GENESIS.hash();
+
+	{
+		SafetyLog log(path);
+		REQUIRE(!log.recovered());
+
+		for (Round round = 1; round <= 5; round++)
+		{
+			state.voted = round;
+			log.persist_sync(state);
+		}
+	}
+
+	{
+		SafetyLog log(path);
+		REQUIRE(log.recovered() == state);
+	}
+
+	// A torn write of the next record leaves the previous one intact.
+	// The records alternate between two 4KiB slots, and the last one went to the first slot.
+	{
+		std::fstream file(path, std::ios::in | std::ios::out | std::ios::binary);
+		file.seekp(4096 + 20);
+		file.write("garbage", 7);
+	}
+
+	SafetyLog log(path);
+	REQUIRE(log.recovered() == state);
+}
+
+TEST_CASE("Coalesce concurrent safety state updates", "[safety_log]")
+{
+	TempDirectory dir;
+	std::filesystem::create_directories(dir.path);
+	SafetyLog log(dir.path / "safety");
+
+	const Round num_updates = 1000;
+	std::atomic<Round> num_durable = 0;
+
+	SafetyState state;
+	for (Round round = 1; round <= num_updates; round++)
+	{
+		state.voted = round;
+		log.persist(state, [&]() { num_durable++; });
+	}
+	state.voted++;
+	log.persist_sync(state);
+
+	REQUIRE(num_durable == num_updates);
+	// updates that were queued while a write was in progress share the next write
+	REQUIRE(log.num_writes() < num_updates);
+}
@@ -0,0 +1,206 @@
+#include <algorithm>
+#include <spdlog/spdlog.h>
+
+#include "safety_rules.h"
+
+namespace HotStuff
+{
+
+SafetyRules::SafetyRules(std::shared_ptr<BlockChain> chain, BlockPtr root, CommitRule rule)
+    : m_chain(std::move(chain)), m_rule(rule), m_voted(root->round()), m_locked(root), m_committed(root)
+{
+}
+
+bool SafetyRules::vote(const Block &block, const std::optional<TimeoutCert> &tc)
+{
+	if (block.round() <= m_voted)
+	{
+		return false;
+	}
+
+	// The QC must certify an ancestor of the block, or it says nothing about the block's branch.
+	auto certified = certified_block(block.cert());
+	if (!certified || !m_chain->extends(block.parent_hash(), certified->hash()))
+	{
+		return false;
+	}
+
+	bool safe;
+	if (m_rule == CommitRule::THREE_CHAIN)
+	{
+		safe = m_chain->extends(block.parent_hash(), m_locked->hash()) || certified->round() > m_locked->round();
+	}
+	else
+	{
+		safe = block.round() == certified->round() + 1 ||
+		       (tc && block.round() == tc->round() + 1 && certified->round() >= tc->max_high_qc_round());
+	}
+
+	if (!safe)
+	{
+		return false;
+	}
+
+	m_voted = block.round();
+	return true;
+}
+
+std::vector<BlockPtr> SafetyRules::update(const QuorumCert &qc)
+{
+	// b2 is certified by the QC, b1 by the QC in b2, and b0 by the QC in b1.
+	auto b2 = certified_block(qc);
+	if (!b2)
+	{
+		return {};
+	}
+
+	if (qc.round() > m_high_qc.round())
+	{
+		m_high_qc = qc;
+	}
+
+	if (m_rule == CommitRule::TWO_CHAIN)
+	{
+		return update_two_chain(b2);
+	}
+
+	auto b1 = m_chain->get(b2->cert().block_hash());
+	if (!b1)
+	{
+		return {};
+	}
+
+	if (b1->round() > m_locked->round())
+	{
+		m_locked = b1;
+	}
+
+	auto b0 = m_chain->get(b1->cert().block_hash());
+	if (!b0 || b2->parent_hash() != b1->hash() || b1->parent_hash() != b0->hash())
+	{
+		return {};
+	}
+
+	return commit(b0);
+}
+
+void SafetyRules::timeout(Round round)
+{
+	m_voted = std::max(m_voted, round);
+}
+
+bool SafetyRules::restore(const SafetyState &state, const QuorumCert &high_qc)
+{
+	auto locked = m_chain->get(state.locked);
+	auto committed = m_chain->get(state.executed);
+	if (!locked || !committed)
+	{
+		return false;
+	}
+
+	m_voted = std::max(m_voted, state.voted);
+	if (locked->round() > m_locked->round())
+	{
+		m_locked = locked;
+	}
+	if (committed->round() > m_committed->round())
+	{
+		m_committed = committed;
+	}
+	// The locked block carries a QC of its own, so the high QC is at least that.
+	for (const auto &qc : {locked->cert(), high_qc})
+	{
+		if (qc.round() > m_high_qc.round() && certified_block(qc))
+		{
+			m_high_qc = qc;
+		}
+	}
+	return true;
+}
+
+BlockPtr SafetyRules::certified_block(const QuorumCert &qc) const
+{
+	// GENESIS_QC refers to GENESIS by an empty hash
+	if (qc.round() == 0 && qc.block_hash() == GENESIS_QC.block_hash())
+	{
+		return m_chain->get(GENESIS.hash());
+	}
+
+	auto block = m_chain->get(qc.block_hash());
+	return block && block->round() == qc.round() ? block : nullptr;
+}
+
+std::vector<BlockPtr> SafetyRules::update_two_chain(const BlockPtr &b2)
+{
+	if (b2->round() > m_locked->round())
+	{
+		m_locked = b2;
+	}
+
+	// Only a QC from the very next round shows that no conflicting block can have been certified in between.
+	auto b1 = m_chain->get(b2->cert().block_hash());
+	if (!b1 || b2->parent_hash() != b1->hash() || b2->round() != b1->round() + 1)
+	{
+		return {};
+	}
+
+	return commit(b1);
+}
+
+std::vector<BlockPtr> SafetyRules::commit(const BlockPtr &b0)
+{
+	if (b0->round() <= m_committed->round())
+	{
+		return {};
+	}
+
+	std::vector<BlockPtr> committed;
+	for (auto block = b0; !block || block->hash() != m_committed->hash(); block = m_chain->get(block->parent_hash()))
+	{
+		if (!block || block->round() < m_committed->round())
+		{
+			// Two conflicting blocks were committed. This cannot happen unless more than a third of the replicas
+			// are faulty.
+			spdlog::critical("block in round {} does not extend the committed block in round {}", b0->round(),
+			                 m_committed->round());
+			return {};
+		}
+		committed.push_back(block);
+	}
+
+	std::reverse(committed.begin(), committed.end());
+	m_committed = b0;
+	return committed;
+}
+
+Round SafetyRules::voted() const
+{
+	return m_voted;
+}
+
+const BlockPtr &SafetyRules::locked() const
+{
+	return m_locked;
+}
+
+const BlockPtr &SafetyRules::committed() const
+{
+	return m_committed;
+}
+
+const QuorumCert &SafetyRules::high_qc() const
+{
+	return m_high_qc;
+}
+
+SafetyState SafetyRules::state() const
+{
+	SafetyState state;
+	state.voted = m_voted;
+	state.locked_round = m_locked->round();
+	state.locked = m_locked->hash();
+	state.executed = m_committed->hash();
+	return state;
+}
+
+} // namespace HotStuff
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <memory>
+#include <optional>
+#include <vector>
+
+#include "blockchain.h"
+#include "crypto.h"
+#include "safety_log.h"
+#include "types.h"
+
+namespace HotStuff
+{
+
+enum class CommitRule
+{
+	// A block is committed once it heads a chain of three certified blocks, as in HotStuff.
+	THREE_CHAIN,
+	// A block is committed once its child from the next round is certified, as in Jolteon and Fast-HotStuff.
+	// This saves a round-trip of commit latency, but a leader that takes over after a timeout needs a TimeoutCert
+	// to justify its proposal, so every replica has to send its timeout to every other one.
+	TWO_CHAIN,
+};
+
+// The voting, locking and commit rules of chained HotStuff.
+//
+// In chained HotStuff, the phases of consecutive blocks are pipelined: the QC that a block carries is the prepare QC
+// of its parent, the pre-commit QC of its grandparent and the commit QC of its great-grandparent. So every new QC
+// locks on the block two links below the certified block, and commits the block three links below it once the three
+// blocks form a chain of direct parents. A block is committed one round-trip after the next one, rather than after
+// three phases of its own. With the two-chain rule, everything happens one link further up.
+class SafetyRules
+{
+  public:
+	// Starts out with root as the locked and committed block, e.g. GENESIS.
+	SafetyRules(std::shared_ptr<BlockChain> chain, BlockPtr root, CommitRule rule = CommitRule::THREE_CHAIN);
+
+	// Returns true if voting for the block is safe, and records the vote. The parent of the block must be in the chain.
+	// A block is never safe unless it is proposed in a round after the last vote. Beyond that:
+	// - with the three-chain rule, it must extend the locked block, or carry a QC from a round after the locked block,
+	//   which means that a quorum has moved past the lock.
+	// - with the two-chain rule, it must carry a QC from the previous round, or follow the round of a TimeoutCert and
+	//   carry a QC at least as high as any that the replicas which timed out had. tc is the TimeoutCert of the
+	//   previous round, if the replica has one.
+	bool vote(const Block &block, const std::optional<TimeoutCert> &tc = std::nullopt);
+
+	// Processes a QC, which may lock on a block and commit blocks. The certified block and its ancestors that the QC
+	// refers to must be in the chain. A QC whose round differs from that of its block is ignored.
+	// Returns the newly committed blocks, oldest first.
+	std::vector<BlockPtr> update(const QuorumCert &qc);
+	// Records that the replica times out in the round, after which it never votes in the round. Otherwise a late
+	// block of the round could be certified with its vote, while its timeout helps form a TimeoutCert that lets the
+	// next leader ignore that QC. The new state must be persisted before the Timeout is signed.
+	void timeout(Round round);
+	// Resumes from a state that was persisted before a restart, and from the highest QC that was kept, if any. The
+	// locked and executed blocks of the state must be in the chain, or nothing is restored and false is returned.
+	bool restore(const SafetyState &state, const QuorumCert &high_qc = GENESIS_QC);
+
+	Round voted() const;
+	const BlockPtr &locked() const;
+	const BlockPtr &committed() const;
+	// Returns the QC with the highest round that was passed to update().
+	const QuorumCert &high_qc() const;
+	SafetyState state() const;
+
+	// Returns the block that the QC certifies, or nullptr if it is not in the chain or if the QC claims another round
+	// for it. Votes sign only the block hash, so the signatures of a QC do not vouch for its round.
+	BlockPtr certified_block(const QuorumCert &qc) const;
+
+  private:
+	std::shared_ptr<BlockChain> m_chain;
+	CommitRule m_rule;
+	Round m_voted = 0;
+	// With the two-chain rule, this is the block with the highest QC.
+	BlockPtr m_locked;
+	BlockPtr m_committed;
+	QuorumCert m_high_qc = GENESIS_QC;
+
+	// b2 is the block certified by the QC.
+	std::vector<BlockPtr> update_two_chain(const BlockPtr &b2);
+	// Commits b0 and its ancestors up to the committed block.
+	std::vector<BlockPtr> commit(const BlockPtr &b0);
+};
+
+} // namespace HotStuff
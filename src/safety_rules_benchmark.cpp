@@ -0,0 +1,69 @@
+#include <catch2/benchmark/catch_benchmark.hpp>
+#include <catch2/catch_test_macros.hpp>
+#include <fmt/core.h>
+
+#include "safety_rules.h"
+
+using namespace HotStuff;
+
+// Returns the blocks of the happy path, in which each block carries the QC of its parent.
+static std::vector<BlockPtr> make_blocks(Round num_rounds)
+{
+	std::vector<BlockPtr> blocks;
+	Hash parent = GENESIS.hash();
+	QuorumCert cert = GENESIS_QC;
+	for (Round round = 1; round <= num_rounds; round++)
+	{
+		blocks.push_back(std::make_shared<const Block>(parent, round, 1, cert));
+		parent = blocks.back()->hash();
+		cert = QuorumCert(parent, round, {});
+	}
+	return blocks;
+}
+
+TEST_CASE("Commit latency", "[safety_rules][benchmark]")
+{
+	const Round num_rounds = 1000;
+	auto blocks = make_blocks(num_rounds);
+
+	for (auto rule : {CommitRule::THREE_CHAIN, CommitRule::TWO_CHAIN})
+	{
+		auto name = rule == CommitRule::THREE_CHAIN ? "three-chain" : "two-chain";
+
+		// A block is proposed at the start of its round, and its QC is formed at the end of it, when the votes reach
+		// the next leader. The latency counts the rounds from the proposal to the QC that commits the block.
+		auto chain = std::make_shared<BlockChain>();
+		SafetyRules rules(chain, chain->get(GENESIS.hash()), rule);
+		Round total_latency = 0;
+		size_t num_committed = 0;
+		for (auto &block : blocks)
+		{
+			chain->add(block);
+			REQUIRE(rules.vote(*block));
+			for (auto &committed : rules.update(QuorumCert(block->hash(), block->round(), {})))
+			{
+				total_latency += block->round() - committed->round() + 1;
+				num_committed++;
+			}
+		}
+
+		double latency = static_cast<double>(total_latency) / num_committed;
+		fmt::print("{}: {} of {} blocks committed, {:.1f} rounds from proposal to commit\n", name, num_committed,
+		           num_rounds, latency);
+		REQUIRE(latency == (rule == CommitRule::THREE_CHAIN ? 3 : 2));
+
+		// the cost of the rules themselves, per round
+		BENCHMARK(fmt::format("Vote and update {} rounds, {}", num_rounds, name))
+		{
+			auto chain = std::make_shared<BlockChain>();
+			SafetyRules rules(chain, chain->get(GENESIS.hash()), rule);
+			for (auto &block : blocks)
+			{
+				chain->add(block);
+				rules.vote(*block);
+				rules.update(QuorumCert(block->hash(), block->round(), {}));
+			}
+			return rules.committed()->round();
+		};
+	}
+}
@@ -0,0 +1,320 @@
+#include <catch2/catch_test_macros.hpp>
+
+#include "safety_rules.h"
+#include "tests/util.h"
+
+using namespace HotStuff;
+
+// A QC without signatures. The rules do not verify QCs, that is up to the caller.
+static QuorumCert certify(const BlockPtr &block)
+{
+	return QuorumCert(block->hash(), block->round(), {});
+}
+
+// A TimeoutCert with empty signatures from replicas that had the given high QC rounds.
+static TimeoutCert timeout(Round round, const std::vector<Round> &high_qc_rounds)
+{
+	return TimeoutCert(round, std::vector<Signature>(high_qc_rounds.size()), high_qc_rounds);
+}
+
+static BlockPtr make_block(const BlockPtr &parent, Round round, const QuorumCert &cert, uint8_t payload = 0)
+{
+	return std::make_shared<const Block>(parent->hash(), round, 1, cert, std::vector<uint8_t>{payload});
+}
+
+TEST_CASE("Commit a block once it heads a chain of three certified blocks", "[safety_rules]")
+{
+	auto chain = std::make_shared<BlockChain>();
+	auto genesis = chain->get(GENESIS.hash());
+	SafetyRules rules(chain, genesis);
+
+	// each block carries the QC of its parent
+	std::vector<BlockPtr> blocks{genesis};
+	for (Round round = 1; round <= 10; round++)
+	{
+		auto &parent = blocks.back();
+		blocks.push_back(make_block(parent, round, round == 1 ? GENESIS_QC : certify(parent)));
+		chain->add(blocks.back());
+	}
+
+	REQUIRE(rules.update(certify(blocks[1])).empty());
+	REQUIRE(rules.locked() == genesis);
+
+	REQUIRE(rules.update(certify(blocks[2])).empty());
+	REQUIRE(rules.locked() == blocks[1]);
+
+	// blocks 1, 2 and 3 form a three-chain
+	auto committed = rules.update(certify(blocks[3]));
+	REQUIRE(committed == std::vector<BlockPtr>{blocks[1]});
+	REQUIRE(rules.locked() == blocks[2]);
+	REQUIRE(rules.committed() == blocks[1]);
+	REQUIRE(rules.high_qc().round() == 3);
+
+	// from now on, each QC commits one more block
+	REQUIRE(rules.update(certify(blocks[4])) == std::vector<BlockPtr>{blocks[2]});
+	// an old QC changes nothing
+	REQUIRE(rules.update(certify(blocks[3])).empty());
+	REQUIRE(rules.high_qc().round() == 4);
+
+	// a QC that skips ahead commits everything up to the new block at once
+	REQUIRE(rules.update(certify(blocks[7])) == std::vector<BlockPtr>{blocks[3], blocks[4], blocks[5]});
+	REQUIRE(rules.committed() == blocks[5]);
+	REQUIRE(rules.locked() == blocks[6]);
+}
+
+TEST_CASE("Commit only along chains of direct parents", "[safety_rules]")
+{
+	auto chain = std::make_shared<BlockChain>();
+	auto genesis = chain->get(GENESIS.hash());
+	SafetyRules rules(chain, genesis);
+
+	auto b1 = make_block(genesis, 1, GENESIS_QC);
+	auto b2 = make_block(b1, 2, certify(b1));
+	// round 3 timed out, so block 4 extends block 2
+	auto b4 = make_block(b2, 4, certify(b2));
+	// block 5 extends block 4, but carries a QC for block 2, since block 4 was not certified in time
+	auto b5 = make_block(b4, 5, certify(b2));
+	auto b6 = make_block(b5, 6, certify(b5));
+	for (auto &block : {b1, b2, b4, b5, b6})
+	{
+		chain->add(block);
+	}
+
+	REQUIRE(rules.update(certify(b2)).empty());
+	// b4 is a child of b2, which is a child of b1, even though round 3 is missing
+	REQUIRE(rules.update(certify(b4)) == std::vector<BlockPtr>{b1});
+	REQUIRE(rules.locked() == b2);
+
+	// b6 is a child of b5, but b5 certifies b2 instead of its parent b4
+	REQUIRE(rules.update(certify(b6)).empty());
+	REQUIRE(rules.committed() == b1);
+	REQUIRE(rules.locked() == b5);
+}
+
+TEST_CASE("Vote only for blocks that are safe", "[safety_rules]")
+{
+	auto chain = std::make_shared<BlockChain>();
+	auto genesis = chain->get(GENESIS.hash());
+	SafetyRules rules(chain, genesis);
+
+	auto b1 = make_block(genesis, 1, GENESIS_QC);
+	auto b2 = make_block(b1, 2, certify(b1));
+	auto b3 = make_block(b2, 3, certify(b2));
+	for (auto &block : {b1, b2, b3})
+	{
+		chain->add(block);
+		REQUIRE(rules.vote(*block));
+		rules.update(block->cert());
+	}
+	REQUIRE(rules.voted() == 3);
+	REQUIRE(!rules.vote(*b3));
+
+	// lock on b2, and commit b1
+	auto b4 = make_block(b3, 4, certify(b3));
+	chain->add(b4);
+	rules.update(b4->cert());
+	REQUIRE(rules.locked() == b2);
+
+	// a fork that does not extend the lock, with a QC no newer than the lock
+	auto fork = make_block(b1, 5, certify(b1), 1);
+	chain->add(fork);
+	REQUIRE(!rules.vote(*fork));
+
+	// a fork that does not extend the lock, but whose QC is newer than it, so a quorum has moved on
+	auto certified_fork = make_block(b1, 3, certify(b1), 2);
+	chain->add(certified_fork);
+	auto newer = make_block(certified_fork, 6, certify(certified_fork), 1);
+	chain->add(newer);
+	REQUIRE(rules.vote(*newer));
+	REQUIRE(rules.voted() == 6);
+
+	// a fork whose QC is newer than the lock, but certifies a block on another branch
+	auto unrelated = make_block(b1, 7, certify(b4), 3);
+	chain->add(unrelated);
+	REQUIRE(!rules.vote(*unrelated));
+
+	// a fork whose QC claims a newer round than that of the block it certifies
+	auto inflated = make_block(b1, 7, QuorumCert(b1->hash(), 5, {}), 4);
+	chain->add(inflated);
+	REQUIRE(!rules.vote(*inflated));
+	REQUIRE(rules.voted() == 6);
+
+	auto state = rules.state();
+	REQUIRE(state.voted == 6);
+	REQUIRE(state.locked == b2->hash());
+	REQUIRE(state.locked_round == 2);
+	REQUIRE(state.executed == b1->hash());
+}
+
+TEST_CASE("Commit a block once its child from the next round is certified", "[safety_rules]")
+{
+	auto chain = std::make_shared<BlockChain>();
+	auto genesis = chain->get(GENESIS.hash());
+	SafetyRules rules(chain, genesis, CommitRule::TWO_CHAIN);
+
+	auto b1 = make_block(genesis, 1, GENESIS_QC);
+	auto b2 = make_block(b1, 2, certify(b1));
+	// round 3 timed out, so block 4 extends block 2
+	auto b4 = make_block(b2, 4, certify(b2));
+	auto b5 = make_block(b4, 5, certify(b4));
+	for (auto &block : {b1, b2, b4, b5})
+	{
+		chain->add(block);
+	}
+
+	REQUIRE(rules.update(certify(b1)).empty());
+	REQUIRE(rules.locked() == b1);
+
+	// blocks 1 and 2 form a two-chain
+	REQUIRE(rules.update(certify(b2)) == std::vector<BlockPtr>{b1});
+	REQUIRE(rules.locked() == b2);
+
+	// block 4 is a child of block 2, but not from the next round
+	REQUIRE(rules.update(certify(b4)).empty());
+	REQUIRE(rules.committed() == b1);
+	REQUIRE(rules.locked() == b4);
+
+	REQUIRE(rules.update(certify(b5)) == std::vector<BlockPtr>{b2, b4});
+	REQUIRE(rules.committed() == b4);
+}
+
+TEST_CASE("Vote after a timeout only with a TimeoutCert that justifies the block", "[safety_rules]")
+{
+	auto chain = std::make_shared<BlockChain>();
+	auto genesis = chain->get(GENESIS.hash());
+	SafetyRules rules(chain, genesis, CommitRule::TWO_CHAIN);
+
+	auto b1 = make_block(genesis, 1, GENESIS_QC);
+	auto b2 = make_block(b1, 2, certify(b1));
+	for (auto &block : {b1, b2})
+	{
+		chain->add(block);
+		REQUIRE(rules.vote(*block));
+	}
+
+	// round 3 timed out, and one of the replicas that timed out had seen a QC for block 2
+	auto tc = timeout(3, {1, 2, 1});
+	REQUIRE(tc.max_high_qc_round() == 2);
+
+	// a block that carries a stale QC
+	auto stale = make_block(b1, 4, certify(b1), 1);
+	chain->add(stale);
+	REQUIRE(!rules.vote(*stale, tc));
+
+	// a block that skips a round without a TimeoutCert for it
+	auto b4 = make_block(b2, 4, certify(b2));
+	chain->add(b4);
+	REQUIRE(!rules.vote(*b4));
+	REQUIRE(!rules.vote(*b4, timeout(2, {1, 1, 1})));
+
+	REQUIRE(rules.vote(*b4, tc));
+	REQUIRE(rules.voted() == 4);
+
+	// a block from the next round, whose parent is not the block that its QC certifies
+	auto fork = make_block(stale, 5, certify(b4), 2);
+	chain->add(fork);
+	REQUIRE(!rules.vote(*fork));
+
+	// a block that claims a QC from the previous round for an older block
+	auto inflated = make_block(b4, 6, QuorumCert(b4->hash(), 5, {}), 3);
+	chain->add(inflated);
+	REQUIRE(!rules.vote(*inflated));
+
+	// back on the happy path
+	auto b5 = make_block(b4, 5, certify(b4));
+	chain->add(b5);
+	REQUIRE(rules.vote(*b5));
+}
+
+TEST_CASE("Do not vote in a round after timing out in it", "[safety_rules]")
+{
+	auto chain = std::make_shared<BlockChain>();
+	auto genesis = chain->get(GENESIS.hash());
+	SafetyRules rules(chain, genesis, CommitRule::TWO_CHAIN);
+
+	auto b1 = make_block(genesis, 1, GENESIS_QC);
+	auto b2 = make_block(b1, 2, certify(b1));
+	auto b3 = make_block(b2, 3, certify(b2));
+	for (auto &block : {b1, b2, b3})
+	{
+		chain->add(block);
+	}
+	REQUIRE(rules.vote(*b1));
+
+	// the replica times out in round 2 with a high QC from round 1, and then block 2 arrives late
+	rules.timeout(2);
+	REQUIRE(rules.state().voted == 2);
+	REQUIRE(!rules.vote(*b2));
+
+	// an older timeout does not lower the round
+	rules.timeout(1);
+	REQUIRE(rules.voted() == 2);
+	REQUIRE(rules.vote(*b3));
+}
+
+TEST_CASE("Ignore QCs that claim another round than their block", "[safety_rules]")
+{
+	auto chain = std::make_shared<BlockChain>();
+	auto genesis = chain->get(GENESIS.hash());
+	SafetyRules rules(chain, genesis, CommitRule::TWO_CHAIN);
+
+	auto b1 = make_block(genesis, 1, GENESIS_QC);
+	auto b2 = make_block(b1, 2, certify(b1));
+	chain->add(b1);
+	chain->add(b2);
+
+	REQUIRE(rules.update(QuorumCert(b2->hash(), 100, {})).empty());
+	REQUIRE(rules.high_qc().round() == 0);
+	REQUIRE(rules.locked() == genesis);
+
+	REQUIRE(rules.update(certify(b2)) == std::vector<BlockPtr>{b1});
+	REQUIRE(rules.high_qc().round() == 2);
+}
+
+TEST_CASE("Resume from a persisted state", "[safety_rules]")
+{
+	auto chain = std::make_shared<BlockChain>();
+	auto genesis = chain->get(GENESIS.hash());
+	std::vector<BlockPtr> blocks{genesis};
+	for (Round round = 1; round <= 5; round++)
+	{
+		auto &parent = blocks.back();
+		blocks.push_back(make_block(parent, round, round == 1 ? GENESIS_QC : certify(parent)));
+		chain->add(blocks.back());
+	}
+
+	SafetyState state;
+	state.voted = 5;
+	state.locked_round = 3;
+	state.locked = blocks[3]->hash();
+	state.executed = blocks[2]->hash();
+
+	SECTION("The blocks of the state are in the chain")
+	{
+		SafetyRules rules(chain, genesis);
+		REQUIRE(rules.restore(state, certify(blocks[4])));
+		REQUIRE(rules.state() == state);
+		REQUIRE(rules.committed() == blocks[2]);
+		REQUIRE(rules.high_qc().round() == 4);
+
+		// neither a block from a round it voted in, nor one that conflicts with the lock
+		auto fork = make_block(blocks[2], 6, certify(blocks[2]), 1);
+		chain->add(fork);
+		REQUIRE(!rules.vote(*blocks[5]));
+		REQUIRE(!rules.vote(*fork));
+	}
+	SECTION("Without a high QC, the QC of the locked block is the highest")
+	{
+		SafetyRules rules(chain, genesis);
+		REQUIRE(rules.restore(state));
+		REQUIRE(rules.high_qc().round() == 2);
+	}
+	SECTION("The locked block is not in the chain")
+	{
+		SafetyRules rules(chain, genesis);
+		state.locked = make_block(blocks[3], 6, certify(blocks[3]), 1)->hash();
+		REQUIRE(!rules.restore(state));
+		REQUIRE(rules.voted() == 0);
+		REQUIRE(rules.locked() == genesis);
+	}
+}
@@ -0,0 +1,68 @@
+#include <botan/ecdsa.h>
+#include <botan/ed25519.h>
+#include <stdexcept>
+
+#include "signature_scheme.h"
+
+namespace HotStuff
+{
+
+std::optional<SignatureScheme> parse_signature_scheme(const std::string &name)
+{
+	if (name == "ecdsa-secp256k1")
+	{
+		return SignatureScheme::ECDSA_SECP256K1;
+	}
+	if (name == "ed25519")
+	{
+		return SignatureScheme::ED25519;
+	}
+	return std::nullopt;
+}
+
+SignatureScheme signature_scheme_of(const Botan::Public_Key &key)
+{
+	auto algo = key.algo_name();
+	if (algo == "ECDSA")
+	{
+		// The scheme depends on the curve, and secp256k1 is the only one supported.
+		auto curve = dynamic_cast<const Botan::EC_PublicKey &>(key).domain().get_curve_oid();
+		if (curve != Botan::OID::from_string("secp256k1"))
+		{
+			throw std::invalid_argument("unsupported ECDSA curve " + curve.to_formatted_string());
+		}
+		return SignatureScheme::ECDSA_SECP256K1;
+	}
+	if (algo == "Ed25519")
+	{
+		return SignatureScheme::ED25519;
+	}
+	throw std::invalid_argument("unsupported key type " + algo);
+}
+
+std::string signature_padding(SignatureScheme scheme)
+{
+	switch (scheme)
+	{
+	case SignatureScheme::ECDSA_SECP256K1:
+		// we sign hashes, so no need to hash again
+		return "Raw";
+	case SignatureScheme::ED25519:
+		return "Pure";
+	}
+	throw std::invalid_argument("unknown signature scheme");
+}
+
+std::unique_ptr<Botan::Private_Key> generate_private_key(SignatureScheme scheme, Botan::RandomNumberGenerator &rng)
+{
+	switch (scheme)
+	{
+	case SignatureScheme::ECDSA_SECP256K1:
+		return std::make_unique<Botan::ECDSA_PrivateKey>(rng, Botan::EC_Group("secp256k1"));
+	case SignatureScheme::ED25519:
+		return std::make_unique<Botan::Ed25519_PrivateKey>(rng);
+	}
+	throw std::invalid_argument("unknown signature scheme");
+}
+
+} // namespace HotStuff
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <botan/pk_keys.h>
+#include <botan/rng.h>
+#include <memory>
+#include <optional>
+#include <string>
+
+namespace HotStuff
+{
+
+// The signature schemes that replicas can use. All replicas must use the same scheme.
+enum class SignatureScheme
+{
+	ECDSA_SECP256K1,
+	ED25519,
+};
+
+// Parses the name of a signature scheme ("ecdsa-secp256k1" or "ed25519"), e.g. from a config file.
+std::optional<SignatureScheme> parse_signature_scheme(const std::string &name);
+
+// Returns the scheme that a key belongs to. Throws std::invalid_argument if the key type is not supported.
+SignatureScheme signature_scheme_of(const Botan::Public_Key &key);
+
+// Returns the padding/EMSA argument to pass to Botan's PK_Signer and PK_Verifier for a scheme.
+std::string signature_padding(SignatureScheme scheme);
+
+std::unique_ptr<Botan::Private_Key> generate_private_key(SignatureScheme scheme, Botan::RandomNumberGenerator &rng);
+
+} // namespace HotStuff
@@ -0,0 +1,228 @@
+#include <algorithm>
+#include <cmath>
+#include <spdlog/spdlog.h>
+
+#include "synchronizer.h"
+
+namespace HotStuff
+{
+
+// Timeouts that are more than a turn of the wheel ahead wait in their slot for another turn.
+static const size_t WHEEL_SLOTS = 512;
+
+Synchronizer::Synchronizer(asio::io_context &io_context, std::shared_ptr<Crypto> crypto, size_t quorum_size,
+                           SynchronizerOptions options)
+    : m_crypto(std::move(crypto)), m_quorum_size(quorum_size), m_options(options),
+      m_wheel(options.tick, WHEEL_SLOTS), m_ticker(io_context)
+{
+}
+
+void Synchronizer::start()
+{
+	if (m_running)
+	{
+		return;
+	}
+
+	m_running = true;
+	m_round_start = std::chrono::steady_clock::now();
+	start_round_timer();
+	tick();
+}
+
+void Synchronizer::stop()
+{
+	m_running = false;
+	m_ticker.cancel();
+	if (m_round_timer)
+	{
+		m_wheel.cancel(*m_round_timer);
+		m_round_timer.reset();
+	}
+}
+
+Round Synchronizer::round() const
+{
+	return m_round;
+}
+
+std::chrono::milliseconds Synchronizer::timeout() const
+{
+	using std::chrono::milliseconds;
+
+	auto timeout = m_options.initial_timeout;
+	if (m_round_duration)
+	{
+		auto measured = std::chrono::duration_cast<milliseconds>(*m_round_duration * m_options.latency_multiplier);
+		timeout = std::clamp(measured, m_options.min_timeout, m_options.max_timeout);
+	}
+
+	double backoff = std::pow(m_options.backoff_factor, static_cast<double>(m_num_timeouts));
+	double max_backoff = static_cast<double>(m_options.max_timeout.count()) / std::max<double>(timeout.count(), 1);
+	if (backoff >= max_backoff)
+	{
+		return std::max(m_options.max_timeout, timeout);
+	}
+
+	return milliseconds(static_cast<milliseconds::rep>(timeout.count() * backoff));
+}
+
+const std::optional<TimeoutCert> &Synchronizer::timeout_cert() const
+{
+	return m_timeout_cert;
+}
+
+void Synchronizer::update(std::variant<QuorumCert, TimeoutCert> cert)
+{
+	if (auto qc = std::get_if<QuorumCert>(&cert))
+	{
+		m_high_qc_round = std::max(m_high_qc_round, qc->round());
+		if (qc->round() >= m_round)
+		{
+			m_timeout_cert.reset();
+			advance(qc->round() + 1, true);
+		}
+		return;
+	}
+
+	auto &tc = std::get<TimeoutCert>(cert);
+	if (tc.round() >= m_round)
+	{
+		m_timeout_cert = tc;
+		advance(tc.round() + 1, false);
+	}
+}
+
+std::optional<TimeoutCert> Synchronizer::add(Timeout timeout)
+{
+	Round round = timeout.round();
+	if (round < m_round || round - m_round > m_options.max_rounds_ahead)
+	{
+		return std::nullopt;
+	}
+
+	auto signature = timeout.signature();
+	if (auto iter = m_timeouts.find(round); iter != m_timeouts.end() && iter->second.signers.test(signature.signer()))
+	{
+		return std::nullopt;
+	}
+
+	// A replica that had a QC for the round would not have timed out in it.
+	if (timeout.high_qc_round() >= round ||
+	    !m_crypto->verify(signature, timeout_hash(round, timeout.high_qc_round())))
+	{
+		spdlog::warn("dropping invalid timeout from {}", signature.signer());
+		return std::nullopt;
+	}
+
+	auto &timeouts = m_timeouts[round];
+	timeouts.signers.set(signature.signer());
+	timeouts.signatures.push_back(std::move(signature));
+	timeouts.high_qc_rounds.push_back(timeout.high_qc_round());
+	if (timeouts.signatures.size() < m_quorum_size)
+	{
+		return std::nullopt;
+	}
+
+	TimeoutCert cert(round, std::move(timeouts.signatures), std::move(timeouts.high_qc_rounds));
+	update(cert);
+	return cert;
+}
+
+void Synchronizer::on_timeout(std::function<void(Timeout)> callback)
+{
+	m_cb_timeout = callback;
+}
+
+void Synchronizer::on_round(std::function<void(Round)> callback)
+{
+	m_cb_round = callback;
+}
+
+void Synchronizer::before_timeout(std::function<void(Round)> callback)
+{
+	m_cb_before_timeout = callback;
+}
+
+void Synchronizer::advance(Round round, bool progress)
+{
+	if (round <= m_round)
+	{
+		return;
+	}
+
+	auto now = std::chrono::steady_clock::now();
+	if (progress)
+	{
+		// Only a round that started and ended with a QC took as long as the network needs for a round.
+		if (m_entered_by_qc && round == m_round + 1)
+		{
+			auto duration = now - m_round_start;
+			m_round_duration = m_round_duration ? (*m_round_duration * 7 + duration) / 8 : duration;
+		}
+		m_num_timeouts = 0;
+	}
+
+	m_entered_by_qc = progress;
+	m_round = round;
+	m_round_start = now;
+	m_timeouts.erase(m_timeouts.begin(), m_timeouts.lower_bound(round));
+	start_round_timer();
+
+	if (m_cb_round)
+	{
+		m_cb_round(round);
+	}
+}
+
+void Synchronizer::start_round_timer()
+{
+	if (m_round_timer)
+	{
+		m_wheel.cancel(*m_round_timer);
+		m_round_timer.reset();
+	}
+
+	if (m_running)
+	{
+		m_round_timer = m_wheel.schedule(timeout(), [this]() { handle_round_timeout(); });
+	}
+}
+
+void Synchronizer::tick()
+{
+	m_wheel.advance();
+
+	m_ticker.expires_after(m_options.tick);
+	m_ticker.async_wait([weak = weak_from_this()](std::error_code error) {
+		auto self = weak.lock();
+		if (!error && self && self->m_running)
+		{
+			self->tick();
+		}
+	});
+}
+
+void Synchronizer::handle_round_timeout()
+{
+	m_round_timer.reset();
+	m_num_timeouts++;
+	spdlog::info("round {} timed out, next timeout is {}ms", m_round, timeout().count());
+
+	if (m_cb_before_timeout)
+	{
+		m_cb_before_timeout(m_round);
+	}
+	Timeout own(m_crypto->sign(timeout_hash(m_round, m_high_qc_round)), m_round, m_high_qc_round);
+	// The timeout is sent again after the next, longer timeout, in case the replicas are still stuck in the round,
+	// e.g. because the first one was lost.
+	start_round_timer();
+
+	if (m_cb_timeout)
+	{
+		m_cb_timeout(own);
+	}
+	add(own);
+}
+
+} // namespace HotStuff
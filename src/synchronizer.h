@@ -1,18 +1,132 @@
 #pragma once
 
+#include <asio/io_context.hpp>
+#include <asio/steady_timer.hpp>
+#include <chrono>
+#include <functional>
+#include <map>
+#include <memory>
+#include <optional>
 #include <variant>
+#include <vector>
 
 #include "crypto.h"
+#include "network.h"
 #include "types.h"
+#include "util/bitset.h"
+#include "util/timer_wheel.h"
 
 namespace HotStuff
 {
 
-class Synchronizer
+class SynchronizerOptions
 {
   public:
-	Round round();
+	// The timeout of a round, until the duration of a round has been measured.
+	std::chrono::milliseconds initial_timeout{1000};
+	// Once rounds have been measured, the timeout is this many times the smoothed duration of a round,
+	// within min_timeout and max_timeout.
+	double latency_multiplier = 4.0;
+	std::chrono::milliseconds min_timeout{50};
+	std::chrono::milliseconds max_timeout{60000};
+	// Each consecutive round that times out multiplies the timeout by this factor, up to max_timeout.
+	double backoff_factor = 2.0;
+	// Resolution of the round timer. Timeouts fire up to one tick late.
+	std::chrono::milliseconds tick{5};
+	// Timeouts for rounds this far beyond the current round are dropped,
+	// which bounds the memory used by rounds that never complete.
+	Round max_rounds_ahead = 64;
+};
+
+// The pacemaker, which moves replicas through the rounds together.
+//
+// A replica enters round r + 1 as soon as it sees a QC or TimeoutCert for round r, however far ahead of its current
+// round that is. If the round does not make progress in time, the replica broadcasts a Timeout, and the timeouts of a
+// quorum form a TimeoutCert that moves everyone on to the next round.
+//
+// The timeout adapts to the network: it is a multiple of the smoothed duration of the rounds that ended with a QC, so
+// a crashed leader costs a few round-trips rather than a fixed pessimistic timeout. While rounds keep timing out, the
+// timeout backs off exponentially, so that replicas whose clocks or links are slow eventually overlap in the same
+// round, and it drops back as soon as a round makes progress again.
+//
+// The round timer runs on a TimerWheel that is ticked by a single asio timer, so that moving on to a new round, which
+// cancels the timer of the old one, takes constant time.
+//
+// The synchronizer is not thread safe. It must only be used from the thread that runs the io_context.
+class Synchronizer : public std::enable_shared_from_this<Synchronizer>
+{
+  public:
+	Synchronizer(asio::io_context &io_context, std::shared_ptr<Crypto> crypto, size_t quorum_size,
+	             SynchronizerOptions options = {});
+
+	// Starts the timer of the current round.
+	void start();
+	void stop();
+
+	Round round() const;
+	// Returns the timeout of the current round.
+	std::chrono::milliseconds timeout() const;
+	// Returns the TimeoutCert of the round before the current one, if the replica entered the round through it.
+	const std::optional<TimeoutCert> &timeout_cert() const;
+
+	// Moves on to the round after the certificate, if the replica is not there yet. The certificate must already have
+	// been verified. A QC also tells the synchronizer the high QC round that goes into the replica's timeouts.
 	void update(std::variant<QuorumCert, TimeoutCert> cert);
+	// Adds a timeout from another replica. Returns the TimeoutCert if the timeout completes a quorum, after moving on
+	// to the next round.
+	std::optional<TimeoutCert> add(Timeout timeout);
+
+	// The callback receives the replica's own Timeout, to send to all other replicas, whenever the current round
+	// times out, and again each time the backed off timeout runs out while the replica is still in the round.
+	// The synchronizer adds the replica's own timeouts itself.
+	void on_timeout(std::function<void(Timeout)> callback);
+	// The callback is called whenever the replica enters a new round, e.g. to propose a block if it is the leader.
+	void on_round(std::function<void(Round)> callback);
+	// The callback is called with the current round right before the replica signs a Timeout for it, e.g. to make
+	// sure that the replica never votes in the round afterwards.
+	void before_timeout(std::function<void(Round)> callback);
+
+  private:
+	class RoundTimeouts
+	{
+	  public:
+		// Replicas whose valid timeout in this round was added.
+		Bitset signers;
+		std::vector<Signature> signatures;
+		std::vector<Round> high_qc_rounds;
+	};
+
+	std::shared_ptr<Crypto> m_crypto;
+	size_t m_quorum_size;
+	SynchronizerOptions m_options;
+
+	Round m_round = 1;
+	Round m_high_qc_round = 0;
+	std::optional<TimeoutCert> m_timeout_cert;
+	std::map<Round, RoundTimeouts> m_timeouts;
+
+	// Number of timeouts in a row, since the last round that ended with a QC.
+	size_t m_num_timeouts = 0;
+	// Smoothed duration of the rounds that started and ended with a QC, if any were measured.
+	std::optional<std::chrono::steady_clock::duration> m_round_duration;
+	std::chrono::steady_clock::time_point m_round_start;
+	// True if the current round was entered through a QC, so its duration says something about the network.
+	bool m_entered_by_qc = false;
+
+	TimerWheel m_wheel;
+	asio::steady_timer m_ticker;
+	std::optional<TimerWheel::TimerID> m_round_timer;
+	bool m_running = false;
+
+	std::function<void(Timeout)> m_cb_timeout;
+	std::function<void(Round)> m_cb_round;
+	std::function<void(Round)> m_cb_before_timeout;
+
+	// Enters the round, if it is after the current one.
+	void advance(Round round, bool progress);
+	void start_round_timer();
+	void tick();
+	void handle_round_timeout();
 };
 
 } // namespace HotStuff
@@ -0,0 +1,145 @@
+#include <asio/io_context.hpp>
+#include <catch2/catch_test_macros.hpp>
+#include <chrono>
+
+#include "synchronizer.h"
+#include "tests/util.h"
+
+using namespace HotStuff;
+using namespace std::chrono_literals;
+
+static Timeout make_timeout(const std::unordered_map<ID, std::shared_ptr<Botan::Private_Key>> &keys,
+                            std::shared_ptr<Peers> peers, ID signer, Round round, Round high_qc_round,
+                            Round signed_high_qc_round)
+{
+	Crypto crypto(signer, keys.at(signer), peers);
+	return Timeout(crypto.sign(timeout_hash(round, signed_high_qc_round)), round, high_qc_round);
+}
+
+static Timeout make_timeout(const std::unordered_map<ID, std::shared_ptr<Botan::Private_Key>> &keys,
+                            std::shared_ptr<Peers> peers, ID signer, Round round, Round high_qc_round)
+{
+	return make_timeout(keys, peers, signer, round, high_qc_round, high_qc_round);
+}
+
+TEST_CASE("Move on to the round after the highest certificate", "[synchronizer]")
+{
+	asio::io_context io_context;
+	auto [peers, keys] = make_peers();
+	auto crypto = std::make_shared<Crypto>(1, keys.at(1), peers);
+	auto synchronizer = std::make_shared<Synchronizer>(io_context, crypto, 3);
+
+	std::vector<Round> rounds;
+	synchronizer->on_round([&](Round round) { rounds.push_back(round); });
+	REQUIRE(synchronizer->round() == 1);
+
+	// a QC from a later round skips the rounds in between
+	synchronizer->update(QuorumCert(GENESIS.hash(), 5, {}));
+	REQUIRE(synchronizer->round() == 6);
+	synchronizer->update(QuorumCert(GENESIS.hash(), 3, {}));
+	REQUIRE(synchronizer->round() == 6);
+
+	synchronizer->update(TimeoutCert(9, {}, {}));
+	REQUIRE(synchronizer->round() == 10);
+	REQUIRE(synchronizer->timeout_cert());
+	REQUIRE(synchronizer->timeout_cert()->round() == 9);
+
+	synchronizer->update(QuorumCert(GENESIS.hash(), 10, {}));
+	REQUIRE(synchronizer->round() == 11);
+	REQUIRE(!synchronizer->timeout_cert());
+
+	REQUIRE(rounds == std::vector<Round>{6, 10, 11});
+}
+
+TEST_CASE("Aggregate timeouts into a TimeoutCert", "[synchronizer]")
+{
+	asio::io_context io_context;
+	auto [peers, keys] = make_peers();
+	auto crypto = std::make_shared<Crypto>(1, keys.at(1), peers);
+	auto synchronizer = std::make_shared<Synchronizer>(io_context, crypto, 3);
+	synchronizer->update(QuorumCert(GENESIS.hash(), 4, {}));
+	REQUIRE(synchronizer->round() == 5);
+
+	REQUIRE(!synchronizer->add(make_timeout(keys, peers, 2, 5, 4)));
+	// duplicate
+	REQUIRE(!synchronizer->add(make_timeout(keys, peers, 2, 5, 4)));
+	// the signature does not cover the high QC round that the timeout claims
+	REQUIRE(!synchronizer->add(make_timeout(keys, peers, 3, 5, 4, 3)));
+	// a high QC from the round that timed out
+	REQUIRE(!synchronizer->add(make_timeout(keys, peers, 3, 5, 5)));
+	// a round that is over
+	REQUIRE(!synchronizer->add(make_timeout(keys, peers, 3, 4, 3)));
+
+	REQUIRE(!synchronizer->add(make_timeout(keys, peers, 3, 5, 2)));
+	auto tc = synchronizer->add(make_timeout(keys, peers, 4, 5, 3));
+	REQUIRE(tc);
+	REQUIRE(tc->round() == 5);
+	REQUIRE(tc->max_high_qc_round() == 4);
+	REQUIRE(crypto->verify(*tc, 3).ok());
+	REQUIRE(!crypto->verify(*tc, 4).ok());
+
+	REQUIRE(synchronizer->round() == 6);
+	REQUIRE(synchronizer->timeout_cert()->round() == 5);
+	REQUIRE(!synchronizer->add(make_timeout(keys, peers, 1, 5, 4)));
+}
+
+TEST_CASE("Back off while rounds time out, and drop back once they make progress", "[synchronizer]")
+{
+	asio::io_context io_context;
+	auto [peers, keys] = make_peers();
+	auto crypto = std::make_shared<Crypto>(1, keys.at(1), peers);
+
+	SynchronizerOptions options;
+	options.initial_timeout = 20ms;
+	options.min_timeout = 5ms;
+	options.backoff_factor = 2;
+	options.tick = 1ms;
+	auto synchronizer = std::make_shared<Synchronizer>(io_context, crypto, 3, options);
+
+	std::vector<Timeout> timeouts;
+	std::vector<Round> timed_out;
+	synchronizer->before_timeout([&](Round round) {
+		// the callback runs before each timeout is signed
+		REQUIRE(timeouts.size() == timed_out.size());
+		timed_out.push_back(round);
+	});
+	synchronizer->on_timeout([&](Timeout timeout) {
+		timeouts.push_back(timeout);
+		if (timeouts.size() == 2)
+		{
+			io_context.stop();
+		}
+	});
+
+	REQUIRE(synchronizer->timeout() == 20ms);
+	auto start = std::chrono::steady_clock::now();
+	synchronizer->start();
+	io_context.run_for(5s);
+	synchronizer->stop();
+
+	// the timeout is sent again after a timeout twice as long
+	REQUIRE(timeouts.size() == 2);
+	REQUIRE(timed_out == std::vector<Round>{1, 1});
+	REQUIRE(std::chrono::steady_clock::now() - start >= 60ms);
+	for (auto &timeout : timeouts)
+	{
+		REQUIRE(timeout.round() == 1);
+		REQUIRE(timeout.high_qc_round() == 0);
+		REQUIRE(crypto->verify(timeout.signature(), timeout_hash(1, 0)).ok());
+	}
+	REQUIRE(synchronizer->timeout() == 80ms);
+
+	// the replica's own timeout was counted, so two more complete the quorum
+	REQUIRE(!synchronizer->add(make_timeout(keys, peers, 2, 1, 0)));
+	REQUIRE(synchronizer->add(make_timeout(keys, peers, 3, 1, 0)));
+	REQUIRE(synchronizer->round() == 2);
+	// a TimeoutCert moves the replicas on, but is no sign of progress
+	REQUIRE(synchronizer->timeout() == 80ms);
+
+	synchronizer->update(QuorumCert(GENESIS.hash(), 2, {}));
+	REQUIRE(synchronizer->timeout() == 20ms);
+
+	// round 3 started and ended with a QC, and was much faster than min_timeout
+	synchronizer->update(QuorumCert(GENESIS.hash(), 3, {}));
+	REQUIRE(synchronizer->timeout() == 5ms);
+}
@@ -1,31 +1,34 @@
+#include <botan/system_rng.h>
 #include <catch2/catch_test_macros.hpp>
+#include <fmt/core.h>
+#include <random>
 
 #include "util.h"
 
-Botan::ECDSA_PrivateKey gen_key()
+std::shared_ptr<Botan::Private_Key> gen_key(SignatureScheme scheme)
 {
-	Botan::ECDSA_PrivateKey key(Botan::system_rng(), Botan::EC_Group("secp256k1"));
-	return key;
+	return generate_private_key(scheme, Botan::system_rng());
 }
 
-std::pair<std::shared_ptr<Peers>, std::unordered_map<ID, Botan::ECDSA_PrivateKey>> make_peers(int num_peers,
-                                                                                              ID first_id)
+std::pair<std::shared_ptr<Peers>, std::unordered_map<ID, std::shared_ptr<Botan::Private_Key>>> make_peers(
+    int num_peers, ID first_id, SignatureScheme scheme)
 {
-	std::unordered_map<ID, Botan::ECDSA_PrivateKey> keys;
+	std::unordered_map<ID, std::shared_ptr<Botan::Private_Key>> keys;
 	auto peers = std::make_shared<Peers>();
 
 	for (ID i = first_id; i < first_id + num_peers; i++)
 	{
-		auto key = gen_key();
+		auto key = gen_key(scheme);
 		keys.insert({i, key});
-		peers->add({i, key});
+		peers->add(i, key);
 	}
 
 	return {peers, keys};
 }
 
-QuorumCert make_qc(std::shared_ptr<Peers> peers, const std::unordered_map<ID, Botan::ECDSA_PrivateKey> &keys,
-                   std::vector<ID> signers, Hash hash, Round round)
+QuorumCert make_qc(std::shared_ptr<Peers> peers,
+                   const std::unordered_map<ID, std::shared_ptr<Botan::Private_Key>> &keys, std::vector<ID> signers,
+                   Hash hash, Round round)
 {
 	std::vector<Signature> sigs;
 	for (ID i : signers)
@@ -40,3 +43,57 @@ QuorumCert make_qc(std::shared_ptr<Peers> peers, const std::unordered_map<ID, Bo
 
 	return QuorumCert(hash, round, std::move(sigs));
 }
+
+std::vector<BlockPtr> make_chain(size_t length, size_t payload_size, uint8_t seed)
+{
+	std::vector<BlockPtr> chain;
+	Hash parent = GENESIS.hash();
+	for (Round round = 1; round <= length; round++)
+	{
+		std::vector<uint8_t> payload(payload_size, static_cast<uint8_t>(round + seed));
+		chain.push_back(std::make_shared<const Block>(parent, round, 1, GENESIS_QC, std::move(payload)));
+		parent = chain.back()->hash();
+	}
+	return chain;
+}
+
+std::vector<std::shared_ptr<Network>> make_networks(asio::io_context &io_context, std::vector<ID> ids,
+                                                    std::function<void()> on_connected)
+{
+	std::vector<std::shared_ptr<Network>> networks;
+	for (size_t i = 0; i < ids.size(); i++)
+	{
+		networks.push_back(std::make_shared<Network>(io_context));
+		networks.back()->serve();
+	}
+
+	auto num_connected = std::make_shared<size_t>(0);
+	size_t num_connections = ids.size() * (ids.size() - 1);
+	for (size_t i = 0; i < ids.size(); i++)
+	{
+		for (size_t j = 0; j < ids.size(); j++)
+		{
+			if (i != j)
+			{
+				networks[i]->connect_to(ids[j], "localhost", fmt::format("{}", networks[j]->server_port()), [=]() {
+					if (++*num_connected == num_connections)
+					{
+						on_connected();
+					}
+				});
+			}
+		}
+	}
+
+	return networks;
+}
+
+TempDirectory::TempDirectory()
+{
+	path = std::filesystem::temp_directory_path() / ("hotstuff-test-" + std::to_string(std::random_device()()));
+}
+
+TempDirectory::~TempDirectory()
+{
+	std::filesystem::remove_all(path);
+}
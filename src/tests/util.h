@@ -1,17 +1,41 @@
 #pragma once
 
-#include <botan/ecdsa.h>
+#include <asio/io_context.hpp>
+#include <botan/pk_keys.h>
+#include <filesystem>
+#include <functional>
 
 #include "../blockchain.h"
 #include "../crypto.h"
+#include "../network.h"
+#include "../signature_scheme.h"
 #include "../types.h"
 
 using namespace HotStuff;
 
-Botan::ECDSA_PrivateKey gen_key();
+std::shared_ptr<Botan::Private_Key> gen_key(SignatureScheme scheme = SignatureScheme::ECDSA_SECP256K1);
 
-std::pair<std::shared_ptr<Peers>, std::unordered_map<ID, Botan::ECDSA_PrivateKey>> make_peers(int num_peers = 4,
-                                                                                              ID first_id = 1);
+std::pair<std::shared_ptr<Peers>, std::unordered_map<ID, std::shared_ptr<Botan::Private_Key>>> make_peers(
+    int num_peers = 4, ID first_id = 1, SignatureScheme scheme = SignatureScheme::ECDSA_SECP256K1);
 
-QuorumCert make_qc(std::shared_ptr<Peers> peers, const std::unordered_map<ID, Botan::ECDSA_PrivateKey> &keys,
+QuorumCert make_qc(std::shared_ptr<Peers> peers,
+                   const std::unordered_map<ID, std::shared_ptr<Botan::Private_Key>> &keys,
                    std::vector<ID> signers = {2, 3, 4}, Hash hash = GENESIS.hash(), Round round = 1);
+
+// Returns blocks for the rounds 1 to length, each the child of the one before and the first a child of GENESIS.
+// Their payloads are filled with the round plus seed, so chains with different seeds fork right after GENESIS.
+std::vector<BlockPtr> make_chain(size_t length, size_t payload_size = 0, uint8_t seed = 0);
+
+// Starts a network for each ID, connects each of them to all others, and calls on_connected once all are connected.
+std::vector<std::shared_ptr<Network>> make_networks(asio::io_context &io_context, std::vector<ID> ids,
+                                                    std::function<void()> on_connected);
+
+// A directory that is removed again, with its contents, when it goes out of scope.
+class TempDirectory
+{
+  public:
+	TempDirectory();
+	~TempDirectory();
+
+	std::filesystem::path path;
+};
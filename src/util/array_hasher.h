@@ -2,7 +2,10 @@
 
 #include <array>
 #include <cstddef>
+#include <cstdint>
+#include <cstring>
 #include <functional>
+#include <type_traits>
 
 namespace std
 {
@@ -10,13 +13,23 @@ template <typename T, size_t N> struct hash<array<T, N>>
 {
 	size_t operator()(const array<T, N> &a) const noexcept
 	{
-		hash<T> hasher;
-		size_t h = 0;
-		for (size_t i = 0; i < N; i++)
+		// Byte arrays used as keys are digests, which are already uniformly distributed.
+		if constexpr (is_same<T, uint8_t>::value && N >= sizeof(size_t))
 		{
-			h = h * 31 + hasher(a[i]);
+			size_t h;
+			memcpy(&h, a.data(), sizeof(h));
+			return h;
+		}
+		else
+		{
+			hash<T> hasher;
+			size_t h = 0;
+			for (size_t i = 0; i < N; i++)
+			{
+				h = h * 31 + hasher(a[i]);
+			}
+			return h;
 		}
-		return h;
 	}
 };
 } // namespace std
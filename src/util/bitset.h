@@ -0,0 +1,81 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace HotStuff
+{
+
+// A growable set of small non-negative integers, stored as a bitmap.
+// Used to store sets of peer IDs compactly.
+class Bitset
+{
+  public:
+	void set(size_t i)
+	{
+		if (i / 64 >= m_words.size())
+		{
+			m_words.resize(i / 64 + 1);
+		}
+		m_words[i / 64] |= uint64_t(1) << (i % 64);
+	}
+
+	bool test(size_t i) const
+	{
+		return i / 64 < m_words.size() && (m_words[i / 64] >> (i % 64)) & 1;
+	}
+
+	// Returns the number of elements in the set.
+	size_t count() const
+	{
+		size_t n = 0;
+		for (auto word : m_words)
+		{
+			n += __builtin_popcountll(word);
+		}
+		return n;
+	}
+
+	// Calls f(i) for each element i of the set, in ascending order.
+	template <typename F> void for_each(F f) const
+	{
+		for (size_t w = 0; w < m_words.size(); w++)
+		{
+			for (uint64_t word = m_words[w]; word != 0; word &= word - 1)
+			{
+				f(w * 64 + __builtin_ctzll(word));
+			}
+		}
+	}
+
+	const std::vector<uint64_t> &words() const
+	{
+		return m_words;
+	}
+
+	bool operator==(const Bitset &other) const
+	{
+		return m_words == other.m_words;
+	}
+
+	template <class Archive> void save(Archive &archive) const
+	{
+		archive(m_words);
+	}
+
+	template <class Archive> void load(Archive &archive)
+	{
+		archive(m_words);
+		while (!m_words.empty() && m_words.back() == 0)
+		{
+			m_words.pop_back();
+		}
+	}
+
+  private:
+	// Trailing zero words are never stored, so equal sets have equal words.
+	std::vector<uint64_t> m_words;
+};
+
+} // namespace HotStuff
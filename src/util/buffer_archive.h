@@ -0,0 +1,185 @@
+#pragma once
+
+#include <cereal/cereal.hpp>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+// Binary archives that read from / write to byte buffers directly instead of going through iostreams.
+// The encoding is identical to that of cereal::BinaryOutputArchive/BinaryInputArchive.
+
+namespace HotStuff
+{
+
+// Output archive that appends to a byte vector.
+class BufferOutputArchive : public cereal::OutputArchive<BufferOutputArchive, cereal::AllowEmptyClassElision>
+{
+  public:
+	BufferOutputArchive(std::vector<uint8_t> &buffer)
+	    : cereal::OutputArchive<BufferOutputArchive, cereal::AllowEmptyClassElision>(this), m_buffer(buffer)
+	{
+	}
+
+	void saveBinary(const void *data, size_t size)
+	{
+		auto bytes = static_cast<const uint8_t *>(data);
+		m_buffer.insert(m_buffer.end(), bytes, bytes + size);
+	}
+
+  private:
+	std::vector<uint8_t> &m_buffer;
+};
+
+// Output archive that only counts the number of bytes that would be written.
+// Used to size a buffer before serializing into it.
+class SizeArchive : public cereal::OutputArchive<SizeArchive, cereal::AllowEmptyClassElision>
+{
+  public:
+	SizeArchive() : cereal::OutputArchive<SizeArchive, cereal::AllowEmptyClassElision>(this)
+	{
+	}
+
+	void saveBinary(const void *, size_t size)
+	{
+		m_size += size;
+	}
+
+	size_t size() const
+	{
+		return m_size;
+	}
+
+  private:
+	size_t m_size = 0;
+};
+
+// Input archive that reads from a byte range without copying it first.
+// The range must outlive the archive.
+class BufferInputArchive : public cereal::InputArchive<BufferInputArchive, cereal::AllowEmptyClassElision>
+{
+  public:
+	BufferInputArchive(const uint8_t *data, size_t size)
+	    : cereal::InputArchive<BufferInputArchive, cereal::AllowEmptyClassElision>(this), m_pos(data),
+	      m_end(data + size)
+	{
+	}
+
+	BufferInputArchive(const std::vector<uint8_t> &buffer) : BufferInputArchive(buffer.data(), buffer.size())
+	{
+	}
+
+	void loadBinary(void *const data, size_t size)
+	{
+		if (size > remaining())
+		{
+			throw cereal::Exception("Failed to read " + std::to_string(size) + " bytes from buffer! Only " +
+			                        std::to_string(remaining()) + " bytes left");
+		}
+
+		std::memcpy(data, m_pos, size);
+		m_pos += size;
+	}
+
+	size_t remaining() const
+	{
+		return static_cast<size_t>(m_end - m_pos);
+	}
+
+  private:
+	const uint8_t *m_pos;
+	const uint8_t *m_end;
+};
+
+template <class T>
+inline typename std::enable_if<std::is_arithmetic<T>::value, void>::type CEREAL_SAVE_FUNCTION_NAME(
+    BufferOutputArchive &ar, T const &t)
+{
+	ar.saveBinary(std::addressof(t), sizeof(t));
+}
+
+template <class T>
+inline typename std::enable_if<std::is_arithmetic<T>::value, void>::type CEREAL_SAVE_FUNCTION_NAME(SizeArchive &ar,
+                                                                                                  T const &t)
+{
+	ar.saveBinary(std::addressof(t), sizeof(t));
+}
+
+template <class T>
+inline typename std::enable_if<std::is_arithmetic<T>::value, void>::type CEREAL_LOAD_FUNCTION_NAME(
+    BufferInputArchive &ar, T &t)
+{
+	ar.loadBinary(std::addressof(t), sizeof(t));
+}
+
+template <class Archive, class T>
+inline typename std::enable_if<std::is_same<Archive, BufferOutputArchive>::value ||
+                                   std::is_same<Archive, SizeArchive>::value ||
+                                   std::is_same<Archive, BufferInputArchive>::value,
+                               void>::type
+CEREAL_SERIALIZE_FUNCTION_NAME(Archive &ar, cereal::NameValuePair<T> &t)
+{
+	ar(t.value);
+}
+
+template <class Archive, class T>
+inline typename std::enable_if<std::is_same<Archive, BufferOutputArchive>::value ||
+                                   std::is_same<Archive, SizeArchive>::value,
+                               void>::type
+CEREAL_SAVE_FUNCTION_NAME(Archive &ar, cereal::SizeTag<T> const &t)
+{
+	ar(t.size);
+}
+
+// cereal resizes a container to its size tag before reading the elements. Each element takes at least one byte, so a
+// size beyond the bytes that are left is forged, and is rejected before it allocates more than the buffer holds.
+template <class T> inline void CEREAL_LOAD_FUNCTION_NAME(BufferInputArchive &ar, cereal::SizeTag<T> &t)
+{
+	ar(t.size);
+	if (t.size > ar.remaining())
+	{
+		throw cereal::Exception("Size tag of " + std::to_string(t.size) + " elements exceeds the " +
+		                        std::to_string(ar.remaining()) + " bytes left in buffer");
+	}
+}
+
+template <class T> inline void CEREAL_SAVE_FUNCTION_NAME(BufferOutputArchive &ar, cereal::BinaryData<T> const &bd)
+{
+	ar.saveBinary(bd.data, static_cast<size_t>(bd.size));
+}
+
+template <class T> inline void CEREAL_SAVE_FUNCTION_NAME(SizeArchive &ar, cereal::BinaryData<T> const &bd)
+{
+	ar.saveBinary(bd.data, static_cast<size_t>(bd.size));
+}
+
+template <class T> inline void CEREAL_LOAD_FUNCTION_NAME(BufferInputArchive &ar, cereal::BinaryData<T> &bd)
+{
+	ar.loadBinary(bd.data, static_cast<size_t>(bd.size));
+}
+
+// Serializes a message into a new buffer that is sized exactly once.
+// The first prefix_size bytes of the buffer are zeroed and left for the caller to fill in (e.g. with a header).
+template <typename Message> std::vector<uint8_t> serialize_to_buffer(const Message &message, size_t prefix_size = 0)
+{
+	SizeArchive size_archive;
+	size_archive(message);
+
+	std::vector<uint8_t> buffer;
+	buffer.reserve(prefix_size + size_archive.size());
+	buffer.resize(prefix_size);
+
+	BufferOutputArchive oarchive(buffer);
+	oarchive(message);
+
+	return buffer;
+}
+
+} // namespace HotStuff
+
+CEREAL_REGISTER_ARCHIVE(HotStuff::BufferOutputArchive)
+CEREAL_REGISTER_ARCHIVE(HotStuff::SizeArchive)
+CEREAL_REGISTER_ARCHIVE(HotStuff::BufferInputArchive)
+
+CEREAL_SETUP_ARCHIVE_TRAITS(HotStuff::BufferInputArchive, HotStuff::BufferOutputArchive)
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <optional>
+#include <unordered_map>
+
+namespace HotStuff
+{
+
+// A bounded map that can be used from several threads.
+// Entries are spread over a number of shards, each with its own lock.
+// When a shard is full, its oldest entry is evicted. A capacity of zero disables the cache.
+template <typename Key, typename Value, size_t NumShards = 16> class ConcurrentCache
+{
+  public:
+	ConcurrentCache(size_t capacity)
+	    : m_shard_capacity(capacity > 0 ? std::max<size_t>(1, capacity / NumShards) : 0)
+	{
+	}
+
+	std::optional<Value> find(const Key &key)
+	{
+		if (m_shard_capacity == 0)
+		{
+			m_misses++;
+			return std::nullopt;
+		}
+
+		auto &shard = shard_for(key);
+		std::lock_guard lock(shard.mutex);
+
+		auto entry = shard.entries.find(key);
+		if (entry == shard.entries.end())
+		{
+			m_misses++;
+			return std::nullopt;
+		}
+
+		m_hits++;
+		return entry->second;
+	}
+
+	void insert(const Key &key, Value value)
+	{
+		if (m_shard_capacity == 0)
+		{
+			return;
+		}
+
+		auto &shard = shard_for(key);
+		std::lock_guard lock(shard.mutex);
+
+		auto [entry, inserted] = shard.entries.insert_or_assign(key, std::move(value));
+		if (!inserted)
+		{
+			return;
+		}
+
+		shard.order.push_back(key);
+		if (shard.order.size() > m_shard_capacity)
+		{
+			shard.entries.erase(shard.order.front());
+			shard.order.pop_front();
+		}
+	}
+
+	uint64_t hits() const
+	{
+		return m_hits;
+	}
+
+	uint64_t misses() const
+	{
+		return m_misses;
+	}
+
+  private:
+	struct Shard
+	{
+		std::mutex mutex;
+		std::unordered_map<Key, Value> entries;
+		std::deque<Key> order; // insertion order, oldest first
+	};
+
+	std::array<Shard, NumShards> m_shards;
+	size_t m_shard_capacity;
+	std::atomic<uint64_t> m_hits = 0;
+	std::atomic<uint64_t> m_misses = 0;
+
+	Shard &shard_for(const Key &key)
+	{
+		return m_shards[std::hash<Key>()(key) % NumShards];
+	}
+};
+
+} // namespace HotStuff
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <botan/hash.h>
+#include <cstddef>
+#include <cstdint>
+
+namespace HotStuff
+{
+
+// Returns the CRC32 of a byte range, using a hash function created with Botan::HashFunction::create("CRC32").
+// Used to detect torn or corrupted records in files.
+inline uint32_t crc32(Botan::HashFunction &hasher, const uint8_t *data, size_t size)
+{
+	uint8_t crc[4];
+	hasher.update(data, size);
+	hasher.final(crc);
+	return uint32_t(crc[0]) << 24 | uint32_t(crc[1]) << 16 | uint32_t(crc[2]) << 8 | crc[3];
+}
+
+inline uint32_t crc32(const uint8_t *data, size_t size)
+{
+	auto hasher = Botan::HashFunction::create_or_throw("CRC32");
+	return crc32(*hasher, data, size);
+}
+
+} // namespace HotStuff
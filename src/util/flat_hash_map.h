@@ -0,0 +1,340 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <new>
+#include <utility>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace HotStuff
+{
+
+// An open addressing hash map for keys that are cryptographic digests, laid out like a Swiss table:
+// the slots are split into groups of 16, with one control byte per slot that holds 7 bits of the key's hash,
+// so that a lookup compares a whole group at once (with SSE2, where available) and rarely touches a slot
+// whose key does not match. Since digests are uniformly random, their first bytes are used as the hash directly.
+// Pointers to values are invalidated when the map grows.
+template <typename Key, typename Value> class FlatHashMap
+{
+	static_assert(sizeof(typename Key::value_type) == 1 && std::tuple_size<Key>::value >= sizeof(uint64_t),
+	              "keys must be byte arrays of at least 8 bytes");
+
+  public:
+	FlatHashMap() = default;
+
+	FlatHashMap(const FlatHashMap &) = delete;
+	FlatHashMap &operator=(const FlatHashMap &) = delete;
+
+	~FlatHashMap()
+	{
+		destroy();
+	}
+
+	size_t size() const
+	{
+		return m_size;
+	}
+
+	bool empty() const
+	{
+		return m_size == 0;
+	}
+
+	// Returns nullptr if the key is not in the map.
+	Value *find(const Key &key)
+	{
+		size_t index = find_index(key);
+		return index == NOT_FOUND ? nullptr : &m_slots[index].value;
+	}
+
+	const Value *find(const Key &key) const
+	{
+		return const_cast<FlatHashMap *>(this)->find(key);
+	}
+
+	size_t count(const Key &key) const
+	{
+		return find_index(key) == NOT_FOUND ? 0 : 1;
+	}
+
+	// Inserts the value unless the key is already in the map.
+	// Returns the value in the map and whether it was inserted.
+	std::pair<Value *, bool> insert(const Key &key, Value value)
+	{
+		if (size_t index = find_index(key); index != NOT_FOUND)
+		{
+			return {&m_slots[index].value, false};
+		}
+
+		size_t index = free_index(hash(key));
+		if (index == NOT_FOUND || (m_growth_left == 0 && m_ctrl[index] == EMPTY))
+		{
+			rehash(m_capacity == 0 ? GROUP_WIDTH : m_capacity * 2);
+			index = free_index(hash(key));
+		}
+
+		if (m_ctrl[index] == EMPTY)
+		{
+			m_growth_left--;
+		}
+		m_ctrl[index] = h2(hash(key));
+		new (&m_slots[index]) Slot{key, std::move(value)};
+		m_size++;
+
+		return {&m_slots[index].value, true};
+	}
+
+	// Returns false if the key was not in the map.
+	bool erase(const Key &key)
+	{
+		size_t index = find_index(key);
+		if (index == NOT_FOUND)
+		{
+			return false;
+		}
+
+		erase_index(index);
+		return true;
+	}
+
+	// Erases all entries for which pred(key, value) returns true, and returns the number of erased entries.
+	template <typename Pred> size_t erase_if(Pred pred)
+	{
+		size_t num_erased = 0;
+		for (size_t i = 0; i < m_capacity; i++)
+		{
+			if (is_full(m_ctrl[i]) && pred(static_cast<const Key &>(m_slots[i].key), m_slots[i].value))
+			{
+				erase_index(i);
+				num_erased++;
+			}
+		}
+		return num_erased;
+	}
+
+	// Calls f(key, value) for each entry, in no particular order.
+	template <typename F> void for_each(F f) const
+	{
+		for (size_t i = 0; i < m_capacity; i++)
+		{
+			if (is_full(m_ctrl[i]))
+			{
+				f(m_slots[i].key, m_slots[i].value);
+			}
+		}
+	}
+
+	void clear()
+	{
+		destroy();
+		m_ctrl.reset();
+		m_slots = nullptr;
+		m_capacity = 0;
+		m_size = 0;
+		m_growth_left = 0;
+	}
+
+  private:
+	struct Slot
+	{
+		Key key;
+		Value value;
+	};
+
+	// Control bytes of free slots are negative, those of full slots hold the low 7 bits of the hash.
+	static constexpr int8_t EMPTY = -128;
+	static constexpr int8_t DELETED = -2;
+	static constexpr size_t GROUP_WIDTH = 16;
+	static constexpr size_t NOT_FOUND = SIZE_MAX;
+
+	std::unique_ptr<int8_t[]> m_ctrl;
+	Slot *m_slots = nullptr;
+	size_t m_capacity = 0; // a power of two, and a multiple of GROUP_WIDTH
+	size_t m_size = 0;
+	// Number of empty slots that can be filled before the map must grow, keeping the load below 7/8.
+	// Deleted slots are not counted, so that lookups always reach an empty slot.
+	size_t m_growth_left = 0;
+
+	static uint64_t hash(const Key &key)
+	{
+		uint64_t h;
+		std::memcpy(&h, key.data(), sizeof(h));
+		return h;
+	}
+
+	static int8_t h2(uint64_t hash)
+	{
+		return static_cast<int8_t>(hash & 0x7f);
+	}
+
+	static bool is_full(int8_t ctrl)
+	{
+		return ctrl >= 0;
+	}
+
+	// Bit i of the result is set if control byte i of the group equals ctrl.
+	static uint32_t match(const int8_t *group, int8_t ctrl)
+	{
+#ifdef __SSE2__
+		__m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i *>(group));
+		return static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(bytes, _mm_set1_epi8(ctrl))));
+#else
+		uint32_t mask = 0;
+		for (size_t i = 0; i < GROUP_WIDTH; i++)
+		{
+			mask |= uint32_t(group[i] == ctrl) << i;
+		}
+		return mask;
+#endif
+	}
+
+	// Bit i of the result is set if slot i of the group is empty or deleted.
+	static uint32_t match_free(const int8_t *group)
+	{
+#ifdef __SSE2__
+		__m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i *>(group));
+		return static_cast<uint32_t>(_mm_movemask_epi8(bytes));
+#else
+		uint32_t mask = 0;
+		for (size_t i = 0; i < GROUP_WIDTH; i++)
+		{
+			mask |= uint32_t(group[i] < 0) << i;
+		}
+		return mask;
+#endif
+	}
+
+	size_t num_groups() const
+	{
+		return m_capacity / GROUP_WIDTH;
+	}
+
+	// Groups are probed quadratically (by triangular numbers), which visits every group once
+	// when the number of groups is a power of two.
+	size_t find_index(const Key &key) const
+	{
+		if (m_capacity == 0)
+		{
+			return NOT_FOUND;
+		}
+
+		uint64_t h = hash(key);
+		size_t group = (h >> 7) & (num_groups() - 1);
+		for (size_t step = 1;; step++)
+		{
+			const int8_t *ctrl = &m_ctrl[group * GROUP_WIDTH];
+			for (uint32_t candidates = match(ctrl, h2(h)); candidates != 0; candidates &= candidates - 1)
+			{
+				size_t index = group * GROUP_WIDTH + __builtin_ctz(candidates);
+				if (m_slots[index].key == key)
+				{
+					return index;
+				}
+			}
+			if (match(ctrl, EMPTY) != 0)
+			{
+				return NOT_FOUND;
+			}
+			group = (group + step) & (num_groups() - 1);
+		}
+	}
+
+	// Returns the first free slot in the probe sequence of a hash, or NOT_FOUND if the map has no slots.
+	size_t free_index(uint64_t h) const
+	{
+		if (m_capacity == 0)
+		{
+			return NOT_FOUND;
+		}
+
+		size_t group = (h >> 7) & (num_groups() - 1);
+		for (size_t step = 1;; step++)
+		{
+			if (uint32_t free = match_free(&m_ctrl[group * GROUP_WIDTH]); free != 0)
+			{
+				return group * GROUP_WIDTH + __builtin_ctz(free);
+			}
+			group = (group + step) & (num_groups() - 1);
+		}
+	}
+
+	void erase_index(size_t index)
+	{
+		m_slots[index].~Slot();
+		m_size--;
+
+		// If the group still has an empty slot, no probe sequence has ever continued past it,
+		// so the slot can become empty again instead of leaving a tombstone.
+		if (match(&m_ctrl[index / GROUP_WIDTH * GROUP_WIDTH], EMPTY) != 0)
+		{
+			m_ctrl[index] = EMPTY;
+			m_growth_left++;
+		}
+		else
+		{
+			m_ctrl[index] = DELETED;
+		}
+	}
+
+	void rehash(size_t capacity)
+	{
+		// If at least half of the used slots are tombstones, rehashing at the same size frees enough space.
+		if (m_size <= m_capacity * 7 / 16)
+		{
+			capacity = std::max(m_capacity, GROUP_WIDTH);
+		}
+
+		auto old_ctrl = std::move(m_ctrl);
+		Slot *old_slots = m_slots;
+		size_t old_capacity = m_capacity;
+
+		m_ctrl = std::make_unique<int8_t[]>(capacity);
+		std::memset(m_ctrl.get(), EMPTY, capacity);
+		m_slots = std::allocator<Slot>().allocate(capacity);
+		m_capacity = capacity;
+		m_growth_left = capacity * 7 / 8 - m_size;
+
+		for (size_t i = 0; i < old_capacity; i++)
+		{
+			if (is_full(old_ctrl[i]))
+			{
+				uint64_t h = hash(old_slots[i].key);
+				size_t index = free_index(h);
+				m_ctrl[index] = h2(h);
+				new (&m_slots[index]) Slot{std::move(old_slots[i])};
+				old_slots[i].~Slot();
+			}
+		}
+
+		if (old_slots)
+		{
+			std::allocator<Slot>().deallocate(old_slots, old_capacity);
+		}
+	}
+
+	void destroy()
+	{
+		if (!m_slots)
+		{
+			return;
+		}
+
+		for (size_t i = 0; i < m_capacity; i++)
+		{
+			if (is_full(m_ctrl[i]))
+			{
+				m_slots[i].~Slot();
+			}
+		}
+		std::allocator<Slot>().deallocate(m_slots, m_capacity);
+	}
+};
+
+} // namespace HotStuff
@@ -0,0 +1,97 @@
+#include <catch2/catch_test_macros.hpp>
+#include <random>
+#include <unordered_map>
+
+#include "crypto.h"
+#include "util/flat_hash_map.h"
+
+using namespace HotStuff;
+
+static Hash random_hash(std::mt19937_64 &rng)
+{
+	Hash hash;
+	for (size_t i = 0; i < hash.size(); i += sizeof(uint64_t))
+	{
+		uint64_t word = rng();
+		std::memcpy(hash.data() + i, &word, sizeof(word));
+	}
+	return hash;
+}
+
+TEST_CASE("FlatHashMap behaves like unordered_map", "[util]")
+{
+	std::mt19937_64 rng(42);
+	FlatHashMap<Hash, uint64_t> map;
+	std::unordered_map<Hash, uint64_t> expected;
+	std::vector<Hash> keys;
+
+	for (uint64_t i = 0; i < 20000; i++)
+	{
+		keys.push_back(random_hash(rng));
+		auto [value, inserted] = map.insert(keys.back(), i);
+		REQUIRE(inserted);
+		REQUIRE(*value == i);
+		expected[keys.back()] = i;
+
+		// erase some keys along the way, to leave tombstones behind
+		if (i % 3 == 0)
+		{
+			auto &key = keys[rng() % keys.size()];
+			REQUIRE(map.erase(key) == (expected.erase(key) == 1));
+		}
+	}
+
+	REQUIRE(!map.insert(keys.back(), 0).second);
+	REQUIRE(map.size() == expected.size());
+
+	for (auto &key : keys)
+	{
+		auto value = map.find(key);
+		auto expected_value = expected.find(key);
+		REQUIRE((value != nullptr) == (expected_value != expected.end()));
+		if (value)
+		{
+			REQUIRE(*value == expected_value->second);
+		}
+	}
+	REQUIRE(map.find(random_hash(rng)) == nullptr);
+
+	size_t num_odd = map.erase_if([](const Hash &, uint64_t value) { return value % 2 == 1; });
+	size_t num_visited = 0;
+	map.for_each([&](const Hash &key, uint64_t value) {
+		REQUIRE(value % 2 == 0);
+		REQUIRE(expected.at(key) == value);
+		num_visited++;
+	});
+	REQUIRE(num_visited + num_odd == expected.size());
+	REQUIRE(map.size() == num_visited);
+
+	map.clear();
+	REQUIRE(map.empty());
+	REQUIRE(map.find(keys[0]) == nullptr);
+}
+
+TEST_CASE("FlatHashMap reuses deleted slots", "[util]")
+{
+	std::mt19937_64 rng(7);
+	FlatHashMap<Hash, int> map;
+
+	// a small map with a lot of churn, which fills it with tombstones
+	std::vector<Hash> live;
+	for (int i = 0; i < 100000; i++)
+	{
+		live.push_back(random_hash(rng));
+		map.insert(live.back(), i);
+		if (live.size() > 10)
+		{
+			REQUIRE(map.erase(live.front()));
+			live.erase(live.begin());
+		}
+	}
+
+	REQUIRE(map.size() == 10);
+	for (auto &key : live)
+	{
+		REQUIRE(map.find(key));
+	}
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <array>
+#include <botan/hash.h>
+#include <botan/sha2_32.h>
+#include <cereal/cereal.hpp>
+#include <cstdint>
+#include <type_traits>
+
+// Output archive that feeds the serialized bytes straight into a hash function, without buffering them.
+// The bytes hashed are identical to those written by cereal::BinaryOutputArchive.
+
+namespace HotStuff
+{
+
+class HashArchive : public cereal::OutputArchive<HashArchive, cereal::AllowEmptyClassElision>
+{
+  public:
+	HashArchive(Botan::HashFunction &hasher)
+	    : cereal::OutputArchive<HashArchive, cereal::AllowEmptyClassElision>(this), m_hasher(hasher)
+	{
+	}
+
+	void saveBinary(const void *data, size_t size)
+	{
+		m_hasher.update(static_cast<const uint8_t *>(data), size);
+	}
+
+  private:
+	Botan::HashFunction &m_hasher;
+};
+
+template <class T>
+inline typename std::enable_if<std::is_arithmetic<T>::value, void>::type CEREAL_SAVE_FUNCTION_NAME(HashArchive &ar,
+                                                                                                  T const &t)
+{
+	ar.saveBinary(std::addressof(t), sizeof(t));
+}
+
+template <class T> inline void CEREAL_SERIALIZE_FUNCTION_NAME(HashArchive &ar, cereal::NameValuePair<T> &t)
+{
+	ar(t.value);
+}
+
+template <class T> inline void CEREAL_SERIALIZE_FUNCTION_NAME(HashArchive &ar, cereal::SizeTag<T> &t)
+{
+	ar(t.size);
+}
+
+template <class T> inline void CEREAL_SAVE_FUNCTION_NAME(HashArchive &ar, cereal::BinaryData<T> const &bd)
+{
+	ar.saveBinary(bd.data, static_cast<size_t>(bd.size));
+}
+
+// Returns the SHA-256 digest of the binary serialization of a message.
+template <typename Message> std::array<uint8_t, 32> sha256_of(const Message &message)
+{
+	std::array<uint8_t, 32> digest;
+	Botan::SHA_256 hasher;
+
+	{
+		HashArchive archive(hasher);
+		archive(message);
+	}
+
+	hasher.final(digest.data());
+	return digest;
+}
+
+} // namespace HotStuff
+
+CEREAL_REGISTER_ARCHIVE(HotStuff::HashArchive)
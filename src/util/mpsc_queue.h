@@ -0,0 +1,70 @@
+#pragma once
+
+#include <atomic>
+#include <optional>
+#include <utility>
+
+namespace HotStuff
+{
+
+// An unbounded lock-free queue for many producers and a single consumer (Dmitry Vyukov's algorithm).
+// Producers link a new node in with a single atomic exchange, and never wait for each other or for the consumer.
+// The consumer may briefly see the queue as empty while a push is halfway done, and then gets the element later.
+template <typename T> class MPSCQueue
+{
+  public:
+	MPSCQueue() : m_head(new Node), m_tail(m_head.load(std::memory_order_relaxed))
+	{
+	}
+
+	MPSCQueue(const MPSCQueue &) = delete;
+	MPSCQueue &operator=(const MPSCQueue &) = delete;
+
+	~MPSCQueue()
+	{
+		while (pop())
+		{
+		}
+		delete m_tail;
+	}
+
+	// Can be called from any thread.
+	void push(T value)
+	{
+		Node *node = new Node;
+		node->value.emplace(std::move(value));
+		Node *prev = m_head.exchange(node, std::memory_order_acq_rel);
+		prev->next.store(node, std::memory_order_release);
+	}
+
+	// Must only be called from one thread at a time.
+	std::optional<T> pop()
+	{
+		Node *next = m_tail->next.load(std::memory_order_acquire);
+		if (!next)
+		{
+			return std::nullopt;
+		}
+
+		// The next node becomes the new stub, which holds no value.
+		std::optional<T> value(std::move(next->value));
+		next->value.reset();
+		delete m_tail;
+		m_tail = next;
+		return value;
+	}
+
+  private:
+	class Node
+	{
+	  public:
+		std::optional<T> value;
+		std::atomic<Node *> next{nullptr};
+	};
+
+	// Producers and the consumer work on opposite ends, which are kept on separate cache lines.
+	alignas(64) std::atomic<Node *> m_head;
+	alignas(64) Node *m_tail;
+};
+
+} // namespace HotStuff
@@ -0,0 +1,48 @@
+#include <catch2/catch_test_macros.hpp>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "util/mpsc_queue.h"
+
+using namespace HotStuff;
+
+TEST_CASE("MPSCQueue keeps the order of each producer", "[util]")
+{
+	const int num_threads = 4;
+	const int num_per_thread = 20000;
+	MPSCQueue<std::unique_ptr<std::pair<int, int>>> queue;
+	REQUIRE(!queue.pop());
+
+	std::vector<std::thread> threads;
+	for (int t = 0; t < num_threads; t++)
+	{
+		threads.emplace_back([&, t]() {
+			for (int i = 0; i < num_per_thread; i++)
+			{
+				queue.push(std::make_unique<std::pair<int, int>>(t, i));
+			}
+		});
+	}
+
+	std::vector<int> next(num_threads, 0);
+	for (int received = 0; received < num_threads * num_per_thread;)
+	{
+		if (auto value = queue.pop())
+		{
+			auto [t, i] = **value;
+			REQUIRE(i == next[t]);
+			next[t]++;
+			received++;
+		}
+	}
+
+	for (auto &thread : threads)
+	{
+		thread.join();
+	}
+	REQUIRE(!queue.pop());
+
+	// values that are still queued are destroyed with the queue
+	queue.push(std::make_unique<std::pair<int, int>>(0, 0));
+}
@@ -0,0 +1,148 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <stdexcept>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace HotStuff
+{
+
+// A hashed timer wheel: timers are kept in a ring of slots, one per tick, and a timer that is due more than one turn
+// of the wheel ahead waits in its slot until the wheel gets around to it again. Scheduling and cancelling a timer take
+// constant time, which suits timers that are almost always cancelled before they expire, such as round timeouts.
+// Timers fire up to one tick late, never early.
+//
+// The wheel does not keep time by itself: advance() must be called regularly, e.g. once per tick.
+// It is not thread safe.
+class TimerWheel
+{
+  public:
+	typedef std::chrono::steady_clock Clock;
+	typedef uint64_t TimerID;
+
+	// Throws std::invalid_argument if the tick is not positive or there are no slots.
+	TimerWheel(Clock::duration tick, size_t num_slots, Clock::time_point now = Clock::now())
+	    : m_tick(tick), m_start(now), m_slots(num_slots)
+	{
+		if (tick <= Clock::duration::zero() || num_slots == 0)
+		{
+			throw std::invalid_argument("a timer wheel needs a positive tick and at least one slot");
+		}
+	}
+
+	Clock::duration tick() const
+	{
+		return m_tick;
+	}
+
+	// Number of timers that have neither fired nor been cancelled.
+	size_t size() const
+	{
+		return m_timers.size();
+	}
+
+	// The callback is called from advance() once the deadline has passed.
+	TimerID schedule(Clock::time_point deadline, std::function<void()> callback)
+	{
+		// Round up, so that the timer does not fire early, but never into a tick that has already been processed.
+		uint64_t tick = std::max(ticks_until(deadline + m_tick - Clock::duration(1)), m_current);
+		TimerID id = m_next_id++;
+		m_timers.emplace(id, Timer{tick, std::move(callback)});
+		m_slots[tick % m_slots.size()].push_back(id);
+		return id;
+	}
+
+	TimerID schedule(Clock::duration delay, std::function<void()> callback, Clock::time_point now = Clock::now())
+	{
+		return schedule(now + delay, std::move(callback));
+	}
+
+	// Returns false if the timer has already fired or was cancelled.
+	bool cancel(TimerID id)
+	{
+		// The ID stays in its slot until the wheel passes it.
+		return m_timers.erase(id) > 0;
+	}
+
+	// Fires the timers that are due by now, tick by tick, and returns how many fired.
+	// Callbacks may schedule and cancel timers.
+	size_t advance(Clock::time_point now = Clock::now())
+	{
+		uint64_t last = ticks_until(now);
+		size_t num_fired = 0;
+
+		while (m_current <= last)
+		{
+			if (m_timers.empty())
+			{
+				// Nothing to fire, so there is no need to walk through the slots one by one.
+				// The IDs of cancelled timers stay behind until the wheel passes them again.
+				m_current = last + 1;
+				break;
+			}
+
+			// Timers that the callbacks schedule go into later ticks, but may land in this slot if they are a whole
+			// turn ahead, so it is swapped out before firing anything.
+			uint64_t tick = m_current++;
+			auto &slot = m_slots[tick % m_slots.size()];
+			std::vector<TimerID> ids;
+			std::swap(ids, slot);
+
+			std::vector<std::function<void()>> due;
+			for (TimerID id : ids)
+			{
+				auto timer = m_timers.find(id);
+				if (timer == m_timers.end())
+				{
+					continue;
+				}
+
+				if (timer->second.tick > tick)
+				{
+					slot.push_back(id);
+					continue;
+				}
+
+				due.push_back(std::move(timer->second.callback));
+				m_timers.erase(timer);
+			}
+
+			for (auto &callback : due)
+			{
+				callback();
+				num_fired++;
+			}
+		}
+
+		return num_fired;
+	}
+
+  private:
+	class Timer
+	{
+	  public:
+		uint64_t tick;
+		std::function<void()> callback;
+	};
+
+	Clock::duration m_tick;
+	Clock::time_point m_start;
+	// The next tick to process. Ticks are counted from m_start.
+	uint64_t m_current = 0;
+	std::vector<std::vector<TimerID>> m_slots;
+	std::unordered_map<TimerID, Timer> m_timers;
+	TimerID m_next_id = 0;
+
+	uint64_t ticks_until(Clock::time_point time) const
+	{
+		return time <= m_start ? 0 : static_cast<uint64_t>((time - m_start) / m_tick);
+	}
+};
+
+} // namespace HotStuff
@@ -0,0 +1,60 @@
+#include <catch2/catch_test_macros.hpp>
+#include <vector>
+
+#include "util/timer_wheel.h"
+
+using namespace HotStuff;
+using namespace std::chrono_literals;
+
+TEST_CASE("TimerWheel fires timers once their deadline has passed", "[util]")
+{
+	auto start = TimerWheel::Clock::now();
+	TimerWheel wheel(10ms, 8, start);
+	std::vector<int> fired;
+
+	wheel.schedule(start + 25ms, [&]() { fired.push_back(25); });
+	wheel.schedule(start + 10ms, [&]() { fired.push_back(10); });
+	// more than one turn of the wheel ahead
+	wheel.schedule(start + 205ms, [&]() { fired.push_back(205); });
+	auto cancelled = wheel.schedule(start + 15ms, [&]() { fired.push_back(15); });
+	REQUIRE(wheel.size() == 4);
+
+	REQUIRE(wheel.cancel(cancelled));
+	REQUIRE(!wheel.cancel(cancelled));
+
+	REQUIRE(wheel.advance(start + 9ms) == 0);
+	REQUIRE(wheel.advance(start + 10ms) == 1);
+	// timers fire late rather than early
+	REQUIRE(wheel.advance(start + 29ms) == 0);
+	REQUIRE(wheel.advance(start + 30ms) == 1);
+	REQUIRE(fired == std::vector<int>{10, 25});
+
+	// the wheel passes the slot of the last timer twice before it is due
+	REQUIRE(wheel.advance(start + 200ms) == 0);
+	REQUIRE(wheel.advance(start + 210ms) == 1);
+	REQUIRE(fired == std::vector<int>{10, 25, 205});
+	REQUIRE(wheel.size() == 0);
+}
+
+TEST_CASE("TimerWheel callbacks can schedule timers", "[util]")
+{
+	auto start = TimerWheel::Clock::now();
+	TimerWheel wheel(1ms, 4, start);
+	int num_fired = 0;
+
+	// a timer that reschedules itself, like a round timer that backs off
+	std::function<void()> callback = [&]() {
+		num_fired++;
+		wheel.schedule(start, callback);
+	};
+	wheel.schedule(start, callback);
+
+	// a timer that a callback schedules for the current tick fires on the next one, not in the same call
+	REQUIRE(wheel.advance(start) == 1);
+	REQUIRE(wheel.advance(start) == 0);
+	REQUIRE(wheel.advance(start + 1ms) == 1);
+	// a long pause catches up tick by tick
+	REQUIRE(wheel.advance(start + 10ms) == 9);
+	REQUIRE(num_fired == 11);
+	REQUIRE(wheel.size() == 1);
+}
@@ -0,0 +1,138 @@
+#include <spdlog/spdlog.h>
+
+#include "vote_aggregator.h"
+
+namespace HotStuff
+{
+
+VoteAggregator::VoteAggregator(std::shared_ptr<Crypto> crypto, size_t quorum_size, VoteAggregatorOptions options)
+    : m_crypto(std::move(crypto)), m_quorum_size(quorum_size), m_options(options)
+{
+}
+
+std::optional<QuorumCert> VoteAggregator::add(Vote vote)
+{
+	std::lock_guard lock(m_mutex);
+
+	Round round_number = vote.round();
+	auto signature = vote.signature();
+	ID signer = signature.signer();
+	if (round_number < m_min_round || round_number - m_min_round > m_options.max_rounds_ahead ||
+	    !m_crypto->knows(signer))
+	{
+		return std::nullopt;
+	}
+
+	auto &round = m_rounds[round_number];
+	if (round.voters.test(signer))
+	{
+		return std::nullopt;
+	}
+
+	if (auto pending = round.pending.find(signer); pending != round.pending.end())
+	{
+		if (pending->second == vote.block_hash())
+		{
+			return std::nullopt;
+		}
+
+		// At most one of the two votes is real, so the pending one is verified before the new one may take its place.
+		Hash block = pending->second;
+		verify(round, block, round.blocks[block]);
+		if (auto cert = certify(round_number, round, block))
+		{
+			return cert;
+		}
+		if (round.voters.test(signer))
+		{
+			return std::nullopt;
+		}
+	}
+
+	auto &votes = round.blocks[vote.block_hash()];
+	votes.unverified.push_back(std::move(signature));
+	round.pending[signer] = vote.block_hash();
+	m_num_votes++;
+
+	if (!m_options.lazy_verification || votes.verified.size() + votes.unverified.size() >= m_quorum_size)
+	{
+		verify(round, vote.block_hash(), votes);
+	}
+
+	return certify(round_number, round, vote.block_hash());
+}
+
+void VoteAggregator::advance(Round round)
+{
+	std::lock_guard lock(m_mutex);
+	drop_rounds_before(round);
+}
+
+size_t VoteAggregator::num_votes() const
+{
+	std::lock_guard lock(m_mutex);
+	return m_num_votes;
+}
+
+void VoteAggregator::verify(RoundVotes &round, const Hash &block, BlockVotes &votes)
+{
+	std::vector<std::pair<Signature, Hash>> batch;
+	for (auto &signature : votes.unverified)
+	{
+		batch.emplace_back(std::move(signature), block);
+	}
+	votes.unverified.clear();
+
+	auto results = m_crypto->verify_batch(batch);
+	for (size_t i = 0; i < batch.size(); i++)
+	{
+		auto &signature = batch[i].first;
+		round.pending.erase(signature.signer());
+		if (results[i].ok())
+		{
+			round.voters.set(signature.signer());
+			votes.verified.push_back(std::move(signature));
+			continue;
+		}
+
+		spdlog::warn("dropping invalid vote from {}", signature.signer());
+		m_num_votes--;
+	}
+}
+
+std::optional<QuorumCert> VoteAggregator::certify(Round round_number, RoundVotes &round, const Hash &block)
+{
+	auto votes = round.blocks.find(block);
+	if (votes->second.verified.size() >= m_quorum_size)
+	{
+		QuorumCert cert(block, round_number, votes->second.verified);
+		drop_rounds_before(round_number + 1);
+		return cert;
+	}
+
+	if (votes->second.verified.empty() && votes->second.unverified.empty())
+	{
+		round.blocks.erase(votes);
+	}
+	return std::nullopt;
+}
+
+void VoteAggregator::drop_rounds_before(Round round)
+{
+	if (round <= m_min_round)
+	{
+		return;
+	}
+	m_min_round = round;
+
+	for (auto iter = m_rounds.begin(); iter != m_rounds.end() && iter->first < round;)
+	{
+		for (auto &[_, votes] : iter->second.blocks)
+		{
+			m_num_votes -= votes.verified.size() + votes.unverified.size();
+		}
+		iter = m_rounds.erase(iter);
+	}
+}
+
+} // namespace HotStuff
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <unordered_map>
+#include <vector>
+
+#include "crypto.h"
+#include "network.h"
+#include "types.h"
+
+namespace HotStuff
+{
+
+class VoteAggregatorOptions
+{
+  public:
+	// Votes for rounds this far beyond the lowest round that is still collected are dropped,
+	// which bounds the memory used by rounds that never complete.
+	Round max_rounds_ahead = 64;
+	// If true, votes are verified in one batch once a quorum of them has arrived, instead of one at a time.
+	// Valid votes are never verified twice, but a quorum is formed with a single batch when all votes are valid.
+	bool lazy_verification = true;
+};
+
+// Collects votes and forms a QuorumCert from them as soon as a quorum of valid votes for a block exists.
+//
+// Votes are grouped by round, with a bitmap of the replicas whose vote in the round was verified, so that duplicate
+// votes are dropped before their signature is looked at. Votes from unknown replicas are dropped right away. Each
+// replica has at most one unverified vote per round: if another vote in its name arrives, for a different block,
+// the pending one is verified first, so that a forged vote cannot keep out the real one, nor pile up. Once a round
+// has a QuorumCert, it and all earlier rounds are dropped, and so are any votes for them that arrive later.
+//
+// The aggregator is thread safe.
+class VoteAggregator
+{
+  public:
+	VoteAggregator(std::shared_ptr<Crypto> crypto, size_t quorum_size, VoteAggregatorOptions options = {});
+
+	// Returns the QuorumCert if the vote completes a quorum.
+	std::optional<QuorumCert> add(Vote vote);
+	// Drops the votes for rounds before round, e.g. after a timeout, and ignores votes for them from now on.
+	void advance(Round round);
+
+	// Returns the number of votes that are held.
+	size_t num_votes() const;
+
+  private:
+	class BlockVotes
+	{
+	  public:
+		std::vector<Signature> verified;
+		std::vector<Signature> unverified;
+	};
+
+	class RoundVotes
+	{
+	  public:
+		// Replicas whose vote in this round was verified.
+		Bitset voters;
+		// The block of the unverified vote of each replica that has one.
+		std::unordered_map<ID, Hash> pending;
+		std::unordered_map<Hash, BlockVotes> blocks;
+	};
+
+	std::shared_ptr<Crypto> m_crypto;
+	size_t m_quorum_size;
+	VoteAggregatorOptions m_options;
+
+	mutable std::mutex m_mutex;
+	std::map<Round, RoundVotes> m_rounds;
+	// Votes for earlier rounds are ignored.
+	Round m_min_round = 0;
+	size_t m_num_votes = 0;
+
+	// Verifies the unverified votes for a block, and drops the invalid ones.
+	void verify(RoundVotes &round, const Hash &block, BlockVotes &votes);
+	// Returns the QuorumCert for the block if it has a quorum of verified votes, after dropping the round.
+	// Otherwise, drops the entry of the block if it has no votes left.
+	std::optional<QuorumCert> certify(Round round_number, RoundVotes &round, const Hash &block);
+	void drop_rounds_before(Round round);
+};
+
+} // namespace HotStuff
@@ -0,0 +1,155 @@
+#include <catch2/catch_test_macros.hpp>
+
+#include "tests/util.h"
+#include "vote_aggregator.h"
+
+using namespace HotStuff;
+
+static Vote make_vote(const std::unordered_map<ID, std::shared_ptr<Botan::Private_Key>> &keys,
+                      std::shared_ptr<Peers> peers, ID signer, const Block &block, Hash signed_hash)
+{
+	Crypto crypto(signer, keys.at(signer), peers);
+	return Vote(crypto.sign(signed_hash), block.hash(), block.round());
+}
+
+TEST_CASE("Form a QuorumCert as soon as a quorum of votes has arrived", "[vote_aggregator]")
+{
+	auto [peers, keys] = make_peers();
+	auto crypto = std::make_shared<Crypto>(1, keys.at(1), peers);
+	Block block(GENESIS.hash(), 1, 1, GENESIS_QC);
+
+	VoteAggregatorOptions options;
+	SECTION("Verify lazily")
+	{
+		options.lazy_verification = true;
+	}
+	SECTION("Verify each vote")
+	{
+		options.lazy_verification = false;
+	}
+	VoteAggregator aggregator(crypto, 3, options);
+
+	REQUIRE(!aggregator.add(make_vote(keys, peers, 1, block, block.hash())));
+	REQUIRE(!aggregator.add(make_vote(keys, peers, 2, block, block.hash())));
+	// duplicate
+	REQUIRE(!aggregator.add(make_vote(keys, peers, 2, block, block.hash())));
+	REQUIRE(aggregator.num_votes() == 2);
+
+	auto cert = aggregator.add(make_vote(keys, peers, 3, block, block.hash()));
+	REQUIRE(cert);
+	REQUIRE(cert->block_hash() == block.hash());
+	REQUIRE(cert->round() == 1);
+	REQUIRE(cert->signers() == std::vector<ID>{1, 2, 3});
+	REQUIRE(crypto->verify(*cert, 3).ok());
+
+	// the round is done, so later votes for it are dropped
+	REQUIRE(aggregator.num_votes() == 0);
+	REQUIRE(!aggregator.add(make_vote(keys, peers, 4, block, block.hash())));
+	REQUIRE(aggregator.num_votes() == 0);
+}
+
+TEST_CASE("Do not let invalid votes count towards a quorum", "[vote_aggregator]")
+{
+	auto [peers, keys] = make_peers();
+	auto crypto = std::make_shared<Crypto>(1, keys.at(1), peers);
+	Block block(GENESIS.hash(), 1, 1, GENESIS_QC);
+	Block other(GENESIS.hash(), 1, 2, GENESIS_QC);
+
+	VoteAggregatorOptions options;
+	SECTION("Verify lazily")
+	{
+		options.lazy_verification = true;
+	}
+	SECTION("Verify each vote")
+	{
+		options.lazy_verification = false;
+	}
+	VoteAggregator aggregator(crypto, 3, options);
+
+	// a vote in the name of replica 1 that does not carry its signature on the block
+	REQUIRE(!aggregator.add(make_vote(keys, peers, 1, block, other.hash())));
+	REQUIRE(!aggregator.add(make_vote(keys, peers, 2, block, block.hash())));
+	REQUIRE(!aggregator.add(make_vote(keys, peers, 3, block, block.hash())));
+
+	// votes for different blocks do not add up
+	REQUIRE(!aggregator.add(make_vote(keys, peers, 4, other, other.hash())));
+
+	// the real vote of replica 1 is still accepted
+	auto cert = aggregator.add(make_vote(keys, peers, 1, block, block.hash()));
+	REQUIRE(cert);
+	REQUIRE(cert->signers() == std::vector<ID>{1, 2, 3});
+	REQUIRE(crypto->verify(*cert, 3).ok());
+}
+
+TEST_CASE("Do not let forged votes for other blocks keep out the real ones", "[vote_aggregator]")
+{
+	auto [peers, keys] = make_peers();
+	auto crypto = std::make_shared<Crypto>(1, keys.at(1), peers);
+	Block block(GENESIS.hash(), 1, 1, GENESIS_QC);
+
+	VoteAggregatorOptions options;
+	SECTION("Verify lazily")
+	{
+		options.lazy_verification = true;
+	}
+	SECTION("Verify each vote")
+	{
+		options.lazy_verification = false;
+	}
+	VoteAggregator aggregator(crypto, 3, options);
+
+	// a vote in the name of each replica, each for another block, none of them signed by the replica
+	for (ID id = 1; id <= 4; id++)
+	{
+		Block fake(GENESIS.hash(), 1, 10 + id, GENESIS_QC);
+		REQUIRE(!aggregator.add(make_vote(keys, peers, id, fake, block.hash())));
+	}
+
+	REQUIRE(!aggregator.add(make_vote(keys, peers, 1, block, block.hash())));
+	REQUIRE(!aggregator.add(make_vote(keys, peers, 2, block, block.hash())));
+	auto cert = aggregator.add(make_vote(keys, peers, 3, block, block.hash()));
+	REQUIRE(cert);
+	REQUIRE(cert->signers() == std::vector<ID>{1, 2, 3});
+}
+
+TEST_CASE("Drop votes from unknown replicas", "[vote_aggregator]")
+{
+	auto [peers, keys] = make_peers();
+	auto crypto = std::make_shared<Crypto>(1, keys.at(1), peers);
+	Block block(GENESIS.hash(), 1, 1, GENESIS_QC);
+	VoteAggregator aggregator(crypto, 3);
+
+	// a signer ID that would take a huge bitmap
+	Crypto stranger(ID(1) << 62, keys.at(1), peers);
+	REQUIRE(!aggregator.add(Vote(stranger.sign(block.hash()), block.hash(), block.round())));
+	REQUIRE(aggregator.num_votes() == 0);
+}
+
+TEST_CASE("Drop votes for old and distant rounds", "[vote_aggregator]")
+{
+	auto [peers, keys] = make_peers();
+	auto crypto = std::make_shared<Crypto>(1, keys.at(1), peers);
+
+	VoteAggregatorOptions options;
+	options.max_rounds_ahead = 10;
+	VoteAggregator aggregator(crypto, 3, options);
+
+	for (Round round = 1; round <= 20; round++)
+	{
+		Block block(GENESIS.hash(), round, 1, GENESIS_QC);
+		aggregator.add(make_vote(keys, peers, 2, block, block.hash()));
+	}
+	// rounds 1 to 10
+	REQUIRE(aggregator.num_votes() == 10);
+
+	aggregator.advance(6);
+	REQUIRE(aggregator.num_votes() == 5);
+
+	Block late(GENESIS.hash(), 5, 1, GENESIS_QC);
+	REQUIRE(!aggregator.add(make_vote(keys, peers, 3, late, late.hash())));
+	REQUIRE(aggregator.num_votes() == 5);
+
+	Block block(GENESIS.hash(), 16, 1, GENESIS_QC);
+	aggregator.add(make_vote(keys, peers, 3, block, block.hash()));
+	REQUIRE(aggregator.num_votes() == 6);
+}